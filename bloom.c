@@ -0,0 +1,159 @@
+
+// bloom.c
+
+// includes
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bloom.h"
+#include "hash.h"
+#include "util.h"
+
+// constants
+
+#define BlockWords 8
+
+static const uint32 Salt[BlockWords] = {
+   0x47B6137B, 0x44974D91, 0x8824AD5B, 0xA2B7289D,
+   0x705495C7, 0x2DF1424B, 0x9EFC4947, 0x5C6BFB31
+};
+
+// functions
+
+// bloom_clear()
+
+void bloom_clear(bloom_t * bloom) {
+
+   ASSERT(bloom!=NULL);
+
+   bloom->key_nb = 0;
+   bloom->block_nb = 0;
+   bloom->buffer = NULL;
+   bloom->block = NULL;
+}
+
+// bloom_free()
+
+void bloom_free(bloom_t * bloom) {
+
+   ASSERT(bloom!=NULL);
+
+   if (bloom->buffer != NULL) my_free(bloom->buffer);
+
+   bloom_clear(bloom);
+}
+
+// bloom_init()
+
+void bloom_init(bloom_t * bloom, int key_nb, int bits_per_key) {
+
+   size_t size;
+   char * address;
+
+   ASSERT(bloom!=NULL);
+   ASSERT(key_nb>=0);
+   ASSERT(bits_per_key>0);
+
+   // one 512-bit block per cache line
+
+   bloom_free(bloom);
+
+   bloom->key_nb = key_nb;
+   bloom->block_nb = (uint32) ((((uint64)key_nb) * bits_per_key + 511) / 512);
+   if (bloom->block_nb == 0) bloom->block_nb = 1;
+
+   size = bloom->block_nb * BlockWords * sizeof(uint64);
+
+   bloom->buffer = my_malloc(size+64);
+
+   address = (char *) bloom->buffer;
+   address += (64 - ((size_t)address & 63)) & 63;
+
+   bloom->block = (uint64 *) address;
+   memset(bloom->block,0,size);
+}
+
+// bloom_add()
+
+void bloom_add(bloom_t * bloom, uint64 key) {
+
+   uint64 hash;
+   uint64 * block;
+   int i;
+
+   ASSERT(bloom!=NULL);
+   ASSERT(bloom->block_nb>0);
+
+   hash = hash_mix_64(key);
+   block = &bloom->block[REDUCE(hash,bloom->block_nb)*BlockWords];
+
+   // one bit in every word of the block
+
+   for (i = 0; i < BlockWords; i++) {
+      block[i] |= U64(1) << ((((uint32)hash) * Salt[i]) >> 26);
+   }
+}
+
+// bloom_test()
+
+bool bloom_test(const bloom_t * bloom, uint64 key) {
+
+   uint64 hash;
+   const uint64 * block;
+   uint64 miss;
+   int i;
+
+   ASSERT(bloom!=NULL);
+   ASSERT(bloom->block_nb>0);
+
+   hash = hash_mix_64(key);
+   block = &bloom->block[REDUCE(hash,bloom->block_nb)*BlockWords];
+
+   miss = 0;
+
+   for (i = 0; i < BlockWords; i++) {
+      miss |= ~block[i] & (U64(1) << ((((uint32)hash) * Salt[i]) >> 26));
+   }
+
+   return miss == 0;
+}
+
+// bloom_memory()
+
+double bloom_memory(const bloom_t * bloom) {
+
+   ASSERT(bloom!=NULL);
+
+   return ((double)bloom->block_nb) * BlockWords * sizeof(uint64);
+}
+
+// bloom_fpr()
+
+double bloom_fpr(const bloom_t * bloom) {
+
+   double load, p, fpr, word;
+   int c;
+
+   ASSERT(bloom!=NULL);
+
+   if (bloom->block_nb == 0) return 1.0;
+
+   // the number of keys in a block is Poisson distributed
+
+   load = ((double)bloom->key_nb) / bloom->block_nb;
+
+   p = exp(-load);
+   fpr = 0.0;
+
+   for (c = 0; c < 10*load+64; c++) {
+      word = 1.0 - pow(1.0-1.0/64.0,c);
+      fpr += p * pow(word,BlockWords);
+      p *= load / (c+1);
+   }
+
+   return fpr;
+}
+
+// end of bloom.c
@@ -0,0 +1,39 @@
+
+// bloom.h
+
+#ifndef BLOOM_H
+#define BLOOM_H
+
+// includes
+
+#include "util.h"
+
+// defines
+
+#define BloomBitsPerKey 16
+
+// types
+
+typedef struct {
+   int key_nb;
+   uint32 block_nb;
+   void * buffer;
+   uint64 * block;
+} bloom_t;
+
+// functions
+
+extern void   bloom_clear  (bloom_t * bloom);
+extern void   bloom_free   (bloom_t * bloom);
+
+extern void   bloom_init   (bloom_t * bloom, int key_nb, int bits_per_key);
+
+extern void   bloom_add    (bloom_t * bloom, uint64 key);
+extern bool   bloom_test   (const bloom_t * bloom, uint64 key);
+
+extern double bloom_memory (const bloom_t * bloom);
+extern double bloom_fpr    (const bloom_t * bloom);
+
+#endif // !defined BLOOM_H
+
+// end of bloom.h
@@ -22,6 +22,12 @@
 
 static const bool UseSlowDebug = FALSE;
 
+// prototypes
+
+static bool king_can_move (const board_t * board);
+static bool check_can_end (const board_t * board);
+static int  evasion_move  (const board_t * board, int from, int to);
+
 // functions
 
 // board_is_ok()
@@ -425,11 +431,144 @@ bool board_is_mate(const board_t * board) {
    ASSERT(board_is_ok(board));
 
    if (!board_is_check(board)) return FALSE;
-   if (board_can_play(board)) return FALSE;
+   if (king_can_move(board)) return FALSE;
+   if (check_can_end(board)) return FALSE;
 
    return TRUE;
 }
 
+// king_can_move()
+
+static bool king_can_move(const board_t * board) {
+
+   int me, king;
+   int dir, inc;
+   int to, piece;
+
+   ASSERT(board_is_ok(board));
+
+   // most checks are met by a king step, tried before generating all moves
+
+   me = board->turn;
+   king = king_pos(board,me);
+
+   for (dir = 0; (inc=KingInc[dir]) != IncNone; dir++) {
+
+      to = king + inc;
+      piece = board->square[to];
+
+      if (piece != Empty && !colour_equal(piece,colour_opp(me))) continue; // own piece or edge
+      if (pseudo_is_legal(move_make(king,to),board)) return TRUE;
+   }
+
+   return FALSE;
+}
+
+// check_can_end()
+
+static bool check_can_end(const board_t * board) {
+
+   const uint8 * ptr;
+   int me, opp, king;
+   int checker, checker_nb;
+   int target[8];
+   int target_nb;
+   int dir, inc;
+   int from, sq, move;
+   int i;
+
+   ASSERT(board_is_ok(board));
+
+   // without a king step, only a capture of the single checker or a
+   // block on its line to the king can end the check
+
+   me = board->turn;
+   opp = colour_opp(me);
+   king = king_pos(board,me);
+
+   checker = SquareNone;
+   checker_nb = 0;
+
+   for (ptr = board->list[opp]; (from=*ptr) != SquareNone; ptr++) {
+      if (piece_attack(board,board->square[from],from,king)) {
+         checker = from;
+         if (++checker_nb > 1) return FALSE; // double check
+      }
+   }
+
+   ASSERT(checker_nb==1);
+
+   target_nb = 0;
+
+   if (piece_is_slider(board->square[checker])) {
+
+      for (dir = 0; (inc=QueenInc[dir]) != IncNone; dir++) {
+         for (sq = king+inc; board->square[sq] == Empty; sq += inc)
+            ;
+         if (sq == checker) break;
+      }
+
+      ASSERT(inc!=IncNone);
+
+      for (sq = king+inc; sq != checker; sq += inc) target[target_nb++] = sq;
+   }
+
+   target[target_nb++] = checker;
+   if (board->ep_square != SquareNone) target[target_nb++] = board->ep_square; // checking pawn taken en passant
+
+   for (ptr = board->list[me]; (from=*ptr) != SquareNone; ptr++) {
+
+      if (from == king) continue;
+
+      for (i = 0; i < target_nb; i++) {
+         move = evasion_move(board,from,target[i]);
+         if (move != MoveNone && pseudo_is_legal(move,board)) return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+// evasion_move()
+
+static int evasion_move(const board_t * board, int from, int to) {
+
+   int piece, opp;
+   int inc, move;
+
+   ASSERT(board_is_ok(board));
+   ASSERT(square_is_ok(from));
+   ASSERT(square_is_ok(to));
+
+   // the pseudo-move of the piece on from to an empty or checker square,
+   // MoveNone if it has none
+
+   piece = board->square[from];
+
+   if (!piece_is_pawn(piece)) {
+      return (piece_attack(board,piece,from,to)) ? move_make(from,to) : MoveNone;
+   }
+
+   opp = colour_opp(piece_colour(piece));
+   inc = (colour_is_white(piece_colour(piece))) ? +16 : -16;
+
+   if (to == from+inc-1 || to == from+inc+1) {
+      if (to != board->ep_square && !colour_equal(board->square[to],opp)) return MoveNone;
+   } else if (to == from+inc) {
+      if (board->square[to] != Empty) return MoveNone;
+   } else if (to == from+2*inc) {
+      if (square_rank(from) != ((inc > 0) ? Rank2 : Rank7)) return MoveNone;
+      if (board->square[from+inc] != Empty || board->square[to] != Empty) return MoveNone;
+   } else {
+      return MoveNone;
+   }
+
+   move = move_make(from,to);
+   if (square_is_promote(to)) move |= MovePromoteQueen; // any piece blocks or captures alike
+
+   return move;
+}
+
 // board_is_stalemate()
 
 bool board_is_stalemate(const board_t * board) {
@@ -8,8 +8,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "bloom.h"
 #include "board.h"
 #include "book.h"
+#include "book_index.h"
+#include "book_mph.h"
+#include "book_pack.h"
+#include "huge.h"
 #include "move.h"
 #include "move_legal.h"
 #include "san.h"
@@ -18,27 +23,22 @@
 
 // types
 
-typedef struct {
-   uint64 key;
-   uint16 move;
-   uint16 count;
-   uint16 n;
-   uint16 sum;
-} entry_t;
+typedef book_entry_t entry_t;
 
 // variables
 
-static FILE * BookFile;
-static int BookSize;
+static book_file_t BookFile[1];
 
 // prototypes
 
-static int    find_pos      (uint64 key);
+static void   index_open    (book_file_t * book, const char file_name[], bool use_index, bool use_filter);
+static bool   mph_open      (book_file_t * book, const char file_name[]);
+static uint64 entry_key     (const void * book, int pos);
 
-static void   read_entry    (entry_t * entry, int n);
-static void   write_entry   (const entry_t * entry, int n);
+static void   write_entry   (book_file_t * book, const entry_t * entry, int n);
 
 static uint64 read_integer  (FILE * file, int size);
+static uint64 read_memory   (const uint8 * address, int size);
 static void   write_integer (FILE * file, int size, uint64 n);
 
 // functions
@@ -47,12 +47,11 @@ static void   write_integer (FILE * file, int size, uint64 n);
 
 void book_clear() {
 
-   BookFile = NULL;
-   BookSize = 0;
+   book_file_clear(BookFile);
 }
 
 bool book_is_open(){
-    return BookFile!=NULL;
+    return BookFile->file!=NULL;
 }
 
 // book_open()
@@ -60,55 +59,26 @@ bool book_is_open(){
 void book_open(const char file_name[]) {
 
    ASSERT(file_name!=NULL);
-   if(FALSE && option_get_bool(Option,"BookLearn")){
-       BookFile = fopen(file_name,"rb+");
-   }else{
-       BookFile = fopen(file_name,"rb");
-   }
-      
-//   if (BookFile == NULL) my_fatal("book_open(): can't open file \"%s\": %s\n",file_name,strerror(errno));
-   if (BookFile == NULL)  return; 
 
-   if (fseek(BookFile,0,SEEK_END) == -1) {
-      my_fatal("book_open(): fseek(): %s\n",strerror(errno));
-   }
-
-   BookSize = ftell(BookFile) / 16;
-//   if (BookSize == 0) my_fatal("book_open(): empty file\n");
-   if (BookSize == 0) {
-      book_close();
-      book_clear(); 
-   };
+   book_file_open(BookFile,file_name);
 }
 
 // book_close()
 
 void book_close() {
 
-   if(BookFile==NULL) return;
-
-   if (fclose(BookFile) == EOF) {
-      my_fatal("book_close(): fclose(): %s\n",strerror(errno));
-   }
+   book_file_close(BookFile);
 }
 
 // is_in_book()
 
 bool is_in_book(const board_t * board) {
 
-   int pos;
-   entry_t entry[1];
-
-   if(BookFile==NULL) return FALSE;
+   if(BookFile->file==NULL) return FALSE;
 
    ASSERT(board!=NULL);
 
-   for (pos = find_pos(board->key); pos < BookSize; pos++) {
-      read_entry(entry,pos);
-      if (entry->key == board->key) return TRUE;
-   }
-
-   return FALSE;
+   return book_file_find(BookFile,board->key) < BookFile->size;
 }
 
 // book_move()
@@ -124,7 +94,7 @@ int book_move(const board_t * board, bool random) {
    list_t list[1];
    int i;
 
-   if(BookFile==NULL) return MoveNone;
+   if(BookFile->file==NULL) return MoveNone;
 
    ASSERT(board!=NULL);
    ASSERT(random==TRUE||random==FALSE);
@@ -173,61 +143,14 @@ int book_move(const board_t * board, bool random) {
 
 void book_moves(list_t * list, const board_t * board) {
 
-   int first_pos;
-   int sum;
-   int pos;
-   entry_t entry[1];
-   int move;
-   int score;
-   char move_string[256];
-
    ASSERT(board!=NULL);
    ASSERT(list!=NULL);
 
-   if(BookFile==NULL) return;
-
-   // null keys are reserved for the header
-   if(board->key==U64(0x0)) return;
-   
-
-
-
-   // init
-
-   list_clear(list);
-
-   first_pos = find_pos(board->key);
-
-   // sum
-
-   sum = 0;
-
-   for (pos = first_pos; pos < BookSize; pos++) {
-
-      read_entry(entry,pos);
-      if (entry->key != board->key) break;
-
-      sum += entry->count;
-   }
-
-   // disp
-
-   for (pos = first_pos; pos < BookSize; pos++) {
-
-      read_entry(entry,pos);
-      if (entry->key != board->key) break;
-
-      move = entry->move;
-      score = (((uint32)entry->count)*((uint32)10000))/sum;  // 32 bit safe!
-
-      if (move != MoveNone && move_is_legal(move,board)) {
-              list_add_ex(list,move,score);
-      }
-   }
+   if(BookFile->file==NULL) return;
 
+   book_file_moves(BookFile,list,board);
 }
 
-
 // book_disp()
 
 void book_disp(const board_t * board) {
@@ -239,7 +162,7 @@ void book_disp(const board_t * board) {
 
    ASSERT(board!=NULL);
 
-   if(BookFile==NULL) return;
+   if(BookFile->file==NULL) return;
 
    book_moves(list,board);
    
@@ -263,7 +186,11 @@ void book_learn_move(const board_t * board, int move, int result) {
    int pos;
    entry_t entry[1];
 
-   if(BookFile==NULL) return;
+   if(BookFile->file==NULL) return;
+
+   // packed books are read-only
+
+   if (BookFile->pack->data != NULL) return;
 
    ASSERT(board!=NULL);
    ASSERT(move_is_ok(move));
@@ -271,9 +198,9 @@ void book_learn_move(const board_t * board, int move, int result) {
 
    ASSERT(move_is_legal(move,board));
 
-   for (pos = find_pos(board->key); pos < BookSize; pos++) {
+   for (pos = book_file_find(BookFile,board->key); pos < BookFile->size; pos++) {
 
-      read_entry(entry,pos);
+      book_file_read(BookFile,entry,pos);
       if (entry->key != board->key) break;
 
       if (entry->move == move) {
@@ -281,7 +208,7 @@ void book_learn_move(const board_t * board, int move, int result) {
          entry->n++;
          entry->sum += result+1;
 
-         write_entry(entry,pos);
+         write_entry(BookFile,entry,pos);
 
          break;
       }
@@ -292,24 +219,205 @@ void book_learn_move(const board_t * board, int move, int result) {
 
 void book_flush() {
 
-   if(BookFile==NULL) return;
+   if(BookFile->file==NULL) return;
 
-   if (fflush(BookFile) == EOF) {
+   if (fflush(BookFile->file) == EOF) {
       my_fatal("book_flush(): fflush(): %s\n",strerror(errno));
    }
 }
 
-// find_pos()
+// book_file_clear()
+
+void book_file_clear(book_file_t * book) {
+
+   ASSERT(book!=NULL);
+
+   book->file = NULL;
+   book->data = NULL;
+   book->data_size = 0;
+   book->copy = FALSE;
+   book->size = 0;
+
+   book_pack_clear(book->pack);
+   book_index_clear(book->index);
+   book_mph_clear(book->mph);
+   bloom_clear(book->filter);
+}
+
+// book_file_open()
+
+bool book_file_open(book_file_t * book, const char file_name[]) {
+
+   bool use_index, use_filter;
+
+   ASSERT(book!=NULL);
+   ASSERT(file_name!=NULL);
+
+   book_file_clear(book);
+
+   if(FALSE && option_get_bool(Option,"BookLearn")){
+       book->file = fopen(file_name,"rb+");
+   }else{
+       book->file = fopen(file_name,"rb");
+   }
+      
+//   if (book->file == NULL) my_fatal("book_open(): can't open file \"%s\": %s\n",file_name,strerror(errno));
+   if (book->file == NULL) return FALSE;
+
+   if (fseek(book->file,0,SEEK_END) == -1) {
+      my_fatal("book_open(): fseek(): %s\n",strerror(errno));
+   }
+
+   book->data_size = ftell(book->file);
+
+   if (book_pack_detect(book->file)) {
+
+      // packed books are always decoded from memory, and keep no index
+      // besides their own block index
+
+      book->data = (const uint8 *) my_file_map(book->file,book->data_size);
+      if (book->data == NULL) book_file_copy(book);
+
+      if (!book_pack_open(book->pack,book->data,book->data_size)) {
+         book_file_close(book);
+         return FALSE;
+      }
+
+      book->size = book->pack->size;
+      if (book->size == 0) {
+         book_file_close(book);
+         return FALSE;
+      }
+
+      if (option_get_bool(Option,"BookFilter")) index_open(book,file_name,FALSE,TRUE);
+
+      return TRUE;
+   }
+
+   book->size = book->data_size / 16;
+   book->data_size = ((size_t)book->size) * 16;
+//   if (book->size == 0) my_fatal("book_open(): empty file\n");
+   if (book->size == 0) {
+      book_file_close(book);
+      return FALSE;
+   };
+
+   // probes read the mapped file directly, and are then thread-safe
+
+   book->data = (const uint8 *) my_file_map(book->file,book->data_size);
+
+   // both cost a pass over the whole book, and are only built when asked
+   // for; a minimal perfect hash written by "build-index" makes them
+   // redundant, its fingerprints already reject absent keys
+
+   use_index = FALSE;
+   use_filter = FALSE;
+
+   if (!mph_open(book,file_name)) {
+      use_index = option_get_bool(Option,"BookIndex");
+      use_filter = option_get_bool(Option,"BookFilter");
+   }
+
+   if (use_index || use_filter) index_open(book,file_name,use_index,use_filter);
+
+   return TRUE;
+}
+
+// book_file_close()
+
+void book_file_close(book_file_t * book) {
 
-static int find_pos(uint64 key) {
+   ASSERT(book!=NULL);
+
+   if (book->file == NULL) return;
+
+   book_index_free(book->index);
+   book_mph_free(book->mph);
+   bloom_free(book->filter);
+
+   if (book->copy) {
+      huge_free((void *)book->data);
+   } else if (book->data != NULL) {
+      my_file_unmap(book->data,book->data_size);
+   }
+
+   if (fclose(book->file) == EOF) {
+      my_fatal("book_close(): fclose(): %s\n",strerror(errno));
+   }
+
+   book_file_clear(book);
+}
+
+// book_file_copy()
+
+void book_file_copy(book_file_t * book) {
+
+   uint8 * data;
+   size_t size;
+
+   ASSERT(book!=NULL);
+   ASSERT(book->file!=NULL);
+
+   // a private copy survives the file being rewritten in place,
+   // where a mapping would fault on truncated pages
+
+   if (book->copy) return;
+
+   size = book->data_size;
+   data = (uint8 *) huge_malloc(size);
+
+   if (fseek(book->file,0,SEEK_SET) == -1) {
+      my_fatal("book_file_copy(): fseek(): %s\n",strerror(errno));
+   }
+
+   if (fread(data,1,size,book->file) != size) {
+      my_fatal("book_file_copy(): fread(): %s\n",strerror(errno));
+   }
+
+   if (book->data != NULL) my_file_unmap(book->data,size);
+
+   book->data = data;
+   book->copy = TRUE;
+
+   if (book->pack->data != NULL) book_pack_open(book->pack,book->data,size);
+}
+
+// book_file_find()
+
+int book_file_find(const book_file_t * book, uint64 key) {
 
    int left, right, mid;
    entry_t entry[1];
 
+   ASSERT(book!=NULL);
+   ASSERT(book->file!=NULL);
+
+   // out-of-book positions are mostly rejected with a single cache line
+
+   if (book->filter->block_nb != 0 && !bloom_test(book->filter,key)) return book->size;
+
+   if (book->pack->data != NULL) return book_pack_find(book->pack,key);
+
+   // the fingerprint rejects most absent keys, the entry settles the rest
+
+   if (book->mph->size != 0) {
+      mid = book_mph_find(book->mph,key);
+      if (mid < 0) return book->size;
+      book_file_read(book,entry,mid);
+      return (entry->key == key) ? mid : book->size;
+   }
+
+   if (book->index->size != 0) {
+      mid = book_index_find(book->index,key);
+      if (mid < 0) return book->size;
+      book_file_read(book,entry,mid);
+      return (entry->key == key) ? mid : book->size;
+   }
+
    // binary search (finds the leftmost entry)
 
    left = 0;
-   right = BookSize-1;
+   right = book->size-1;
 
    ASSERT(left<=right);
 
@@ -318,7 +426,7 @@ static int find_pos(uint64 key) {
       mid = (left + right) / 2;
       ASSERT(mid>=left&&mid<right);
 
-      read_entry(entry,mid);
+      book_file_read(book,entry,mid);
 
       if (key <= entry->key) {
          right = mid;
@@ -329,45 +437,296 @@ static int find_pos(uint64 key) {
 
    ASSERT(left==right);
 
-   read_entry(entry,left);
+   book_file_read(book,entry,left);
 
-   return (entry->key == key) ? left : BookSize;
+   return (entry->key == key) ? left : book->size;
 }
 
-// read_entry()
+// book_file_read()
+
+void book_file_read(const book_file_t * book, entry_t * entry, int n) {
 
-static void read_entry(entry_t * entry, int n) {
+   const uint8 * address;
+   book_cache_t cache[1];
 
+   ASSERT(book!=NULL);
    ASSERT(entry!=NULL);
-   ASSERT(n>=0&&n<BookSize);
+   ASSERT(n>=0&&n<book->size);
+
+   if (book->pack->data != NULL) {
+      book_cache_clear(cache);
+      if (!book_cache_read(cache,book,entry,n)) {
+         my_fatal("book_file_read(): corrupt block %d\n",n/PackBlockSize);
+      }
+      return;
+   }
+
+   if (book->data != NULL) {
+
+      address = book->data + ((size_t)n)*16;
 
-   if (fseek(BookFile,n*16,SEEK_SET) == -1) {
+      entry->key   = read_memory(address,8);
+      entry->move  = read_memory(address+8,2);
+      entry->count = read_memory(address+10,2);
+      entry->n     = read_memory(address+12,2);
+      entry->sum   = read_memory(address+14,2);
+
+      return;
+   }
+
+   if (fseek(book->file,n*16,SEEK_SET) == -1) {
       my_fatal("read_entry(): fseek(): %s\n",strerror(errno));
    }
 
-   entry->key   = read_integer(BookFile,8);
-   entry->move  = read_integer(BookFile,2);
-   entry->count = read_integer(BookFile,2);
-   entry->n     = read_integer(BookFile,2);
-   entry->sum   = read_integer(BookFile,2);
+   entry->key   = read_integer(book->file,8);
+   entry->move  = read_integer(book->file,2);
+   entry->count = read_integer(book->file,2);
+   entry->n     = read_integer(book->file,2);
+   entry->sum   = read_integer(book->file,2);
+}
+
+// book_file_entries()
+
+int book_file_entries(const book_file_t * book, uint64 key, entry_t entry[], int size) {
+
+   int pos;
+   int n;
+
+   ASSERT(book!=NULL);
+   ASSERT(entry!=NULL);
+   ASSERT(size>0);
+
+   // null keys are reserved for the header
+
+   if (key == U64(0x0)) return 0;
+
+   if (book->pack->data != NULL) {
+      if (book->filter->block_nb != 0 && !bloom_test(book->filter,key)) return 0;
+      return book_pack_entries(book->pack,key,entry,size);
+   }
+
+   n = 0;
+
+   for (pos = book_file_find(book,key); pos < book->size && n < size; pos++) {
+
+      book_file_read(book,&entry[n],pos);
+      if (entry[n].key != key) break;
+
+      n++;
+   }
+
+   return n;
+}
+
+// book_file_moves()
+
+void book_file_moves(const book_file_t * book, list_t * list, const board_t * board) {
+
+   int entry_nb;
+   int sum;
+   int i;
+   entry_t entry[ListSize];
+   int move;
+   int score;
+
+   ASSERT(book!=NULL);
+   ASSERT(board!=NULL);
+   ASSERT(list!=NULL);
+
+   // init
+
+   list_clear(list);
+
+   // null keys are reserved for the header
+   if(board->key==U64(0x0)) return;
+
+   // one lookup, which packed books answer with a single block decode
+
+   entry_nb = book_file_entries(book,board->key,entry,ListSize);
+
+   // sum
+
+   sum = 0;
+
+   for (i = 0; i < entry_nb; i++) sum += entry[i].count;
+
+   // disp
+
+   for (i = 0; i < entry_nb; i++) {
+
+      move = entry[i].move;
+      score = (((uint32)entry[i].count)*((uint32)10000))/sum;  // 32 bit safe!
+
+      if (move != MoveNone && move_is_legal(move,board)) {
+              list_add_ex(list,move,score);
+      }
+   }
+}
+
+// book_cache_clear()
+
+void book_cache_clear(book_cache_t * cache) {
+
+   ASSERT(cache!=NULL);
+
+   cache->block = -1;
+   cache->valid = FALSE;
+}
+
+// book_cache_read()
+
+bool book_cache_read(book_cache_t * cache, const book_file_t * book, entry_t * entry, int n) {
+
+   int block;
+
+   ASSERT(cache!=NULL);
+   ASSERT(book!=NULL);
+   ASSERT(entry!=NULL);
+   ASSERT(n>=0&&n<book->size);
+
+   // sequential readers of packed books decode each block once, a block
+   // that does not decode reads as header entries and returns FALSE,
+   // which only verify-book goes on from
+
+   if (book->pack->data == NULL) {
+      book_file_read(book,entry,n);
+      return TRUE;
+   }
+
+   block = n / PackBlockSize;
+
+   if (block != cache->block) {
+      cache->valid = book_pack_block(book->pack,block,cache->entry) >= 0;
+      if (!cache->valid) memset(cache->entry,0,sizeof(cache->entry));
+      cache->block = block;
+   }
+
+   *entry = cache->entry[n%PackBlockSize];
+
+   return cache->valid;
+}
+
+// index_open()
+
+static void index_open(book_file_t * book, const char file_name[], bool use_index, bool use_filter) {
+
+   char index_file[StringSize];
+   uint64 digest;
+   uint64 * key;
+   sint32 * first;
+   uint64 last_key;
+   entry_t block[PackBlockSize];
+   int size;
+   int pos;
+
+   ASSERT(book!=NULL);
+   ASSERT(file_name!=NULL);
+
+   snprintf(index_file,StringSize,"%s.idx",file_name);
+   index_file[StringSize-1] = '\0';
+
+   digest = (use_index) ? book_digest(entry_key,book,book->size) : U64(0x0);
+
+   if (use_index && book_index_load(book->index,index_file,book->size,digest)) {
+      if (!use_filter) return;
+      use_index = FALSE;
+   }
+
+   // one sequential pass collecting the first position of every key
+
+   key = (uint64 *) my_malloc(book->size*sizeof(uint64));
+   first = (sint32 *) my_malloc(book->size*sizeof(sint32));
+
+   if (fseek(book->file,0,SEEK_SET) == -1) {
+      my_fatal("index_open(): fseek(): %s\n",strerror(errno));
+   }
+
+   size = 0;
+   last_key = U64(0x0);
+
+   for (pos = 0; pos < book->size; pos++) {
+
+      if (book->pack->data != NULL) {
+         if (pos % PackBlockSize == 0 && book_pack_block(book->pack,pos/PackBlockSize,block) < 0) {
+            my_fatal("index_open(): corrupt block %d\n",pos/PackBlockSize);
+            memset(block,0,sizeof(block));
+         }
+         key[size] = block[pos%PackBlockSize].key;
+      } else if (book->data != NULL) {
+         key[size] = read_memory(book->data+((size_t)pos)*16,8);
+      } else {
+         key[size] = read_integer(book->file,8);
+         read_integer(book->file,8); // move, count and learn
+      }
+
+      // null keys are reserved for the header
+
+      if (key[size] != U64(0x0) && key[size] != last_key) {
+         ASSERT(key[size]>last_key);
+         last_key = key[size];
+         first[size++] = pos;
+      }
+   }
+
+   if (use_filter) {
+      bloom_init(book->filter,size,BloomBitsPerKey);
+      for (pos = 0; pos < size; pos++) bloom_add(book->filter,key[pos]);
+   }
+
+   if (use_index) {
+      book_index_build(book->index,key,first,size,book->size);
+      if (option_get_bool(Option,"BookIndexSave")) book_index_save(book->index,index_file,digest);
+   }
+
+   my_free(key);
+   my_free(first);
+}
+
+// mph_open()
+
+static bool mph_open(book_file_t * book, const char file_name[]) {
+
+   char mph_file[StringSize];
+
+   ASSERT(book!=NULL);
+   ASSERT(file_name!=NULL);
+
+   snprintf(mph_file,StringSize,"%s.mph",file_name);
+   mph_file[StringSize-1] = '\0';
+
+   return book_mph_load(book->mph,mph_file,book->size,book_digest(entry_key,book,book->size));
+}
+
+// entry_key()
+
+static uint64 entry_key(const void * book, int pos) {
+
+   entry_t entry[1];
+
+   ASSERT(book!=NULL);
+
+   book_file_read((const book_file_t *) book,entry,pos);
+
+   return entry->key;
 }
 
 // write_entry()
 
-static void write_entry(const entry_t * entry, int n) {
+static void write_entry(book_file_t * book, const entry_t * entry, int n) {
 
+   ASSERT(book!=NULL);
    ASSERT(entry!=NULL);
-   ASSERT(n>=0&&n<BookSize);
+   ASSERT(n>=0&&n<book->size);
 
-   if (fseek(BookFile,n*16,SEEK_SET) == -1) {
+   if (fseek(book->file,n*16,SEEK_SET) == -1) {
       my_fatal("write_entry(): fseek(): %s\n",strerror(errno));
    }
 
-   write_integer(BookFile,8,entry->key);
-   write_integer(BookFile,2,entry->move);
-   write_integer(BookFile,2,entry->count);
-   write_integer(BookFile,2,entry->n);
-   write_integer(BookFile,2,entry->sum);
+   write_integer(book->file,8,entry->key);
+   write_integer(book->file,2,entry->move);
+   write_integer(book->file,2,entry->count);
+   write_integer(book->file,2,entry->n);
+   write_integer(book->file,2,entry->sum);
 }
 
 // read_integer()
@@ -402,6 +761,23 @@ static uint64 read_integer(FILE * file, int size) {
    return n;
 }
 
+// read_memory()
+
+static uint64 read_memory(const uint8 * address, int size) {
+
+   uint64 n;
+   int i;
+
+   ASSERT(address!=NULL);
+   ASSERT(size>0&&size<=8);
+
+   n = 0;
+
+   for (i = 0; i < size; i++) n = (n << 8) | address[i];
+
+   return n;
+}
+
 // write_integer()
 
 static void write_integer(FILE * file, int size, uint64 n) {
@@ -6,10 +6,34 @@
 
 // includes
 
+#include "bloom.h"
 #include "board.h"
+#include "book_index.h"
+#include "book_mph.h"
+#include "book_pack.h"
 #include "util.h"
 #include "list.h"
 
+// types
+
+typedef struct {
+   FILE * file;
+   const uint8 * data;
+   size_t data_size;
+   bool copy;
+   int size;
+   book_pack_t pack[1];
+   book_index_t index[1];
+   book_mph_t mph[1];
+   bloom_t filter[1];
+} book_file_t;
+
+typedef struct {
+   int block; // decoded in entry[], -1 for none
+   bool valid; // FALSE when the block did not decode
+   book_entry_t entry[PackBlockSize];
+} book_cache_t;
+
 // functions
 
 extern void book_clear      ();
@@ -26,6 +50,19 @@ extern void book_disp       (const board_t * board);
 extern void book_learn_move (const board_t * board, int move, int result);
 extern void book_flush      ();
 
+extern void book_file_clear   (book_file_t * book);
+extern bool book_file_open    (book_file_t * book, const char file_name[]);
+extern void book_file_close   (book_file_t * book);
+extern void book_file_copy    (book_file_t * book);
+
+extern int  book_file_find    (const book_file_t * book, uint64 key);
+extern void book_file_read    (const book_file_t * book, book_entry_t * entry, int n);
+extern int  book_file_entries (const book_file_t * book, uint64 key, book_entry_t entry[], int size);
+extern void book_file_moves   (const book_file_t * book, list_t * list, const board_t * board);
+
+extern void book_cache_clear  (book_cache_t * cache);
+extern bool book_cache_read   (book_cache_t * cache, const book_file_t * book, book_entry_t * entry, int n);
+
 #endif // !defined BOOK_H
 
 // end of book.h
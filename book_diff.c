@@ -0,0 +1,452 @@
+
+// book_diff.c
+
+// includes
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "book_diff.h"
+#include "book_pack.h"
+#include "move.h"
+#include "util.h"
+
+// constants
+
+#define ReadBufferSize (1<<20)
+
+// types
+
+typedef struct {
+   uint64 key;
+   uint16 move;
+   uint16 count;
+   uint16 n;
+   uint16 sum;
+} entry_t;
+
+typedef struct {
+   FILE * file;
+   int size;
+   int pos;
+   bool next_ok;
+   entry_t next[1];
+} book_t;
+
+typedef struct {
+   entry_t * entry;
+   int size;
+   int alloc;
+   int total;
+} group_t;
+
+typedef struct {
+   int pos_1;
+   int pos_2;
+   int pos_common;
+   int pos_added;
+   int pos_removed;
+   int move_added;
+   int move_removed;
+   int move_changed;
+} stats_t;
+
+// variables
+
+static book_t In1[1];
+static book_t In2[1];
+
+static FILE * Out;
+static bool Summary;
+static double Threshold;
+
+// prototypes
+
+static void   book_open     (book_t * book, const char file_name[]);
+static void   book_close    (book_t * book);
+static bool   read_group    (book_t * book, group_t * group);
+static bool   read_entry    (book_t * book, entry_t * entry);
+
+static void   group_init    (group_t * group);
+static void   group_free    (group_t * group);
+static void   group_add     (group_t * group, const entry_t * entry);
+
+static void   diff_position (const group_t * g1, const group_t * g2, stats_t * stats);
+static void   report_group  (const char tag[], const group_t * group);
+
+static double share         (const group_t * group, int i);
+
+// functions
+
+// book_diff()
+
+void book_diff(int argc, char * argv[]) {
+
+   int i;
+   const char * in_file_1;
+   const char * in_file_2;
+   const char * out_file;
+   group_t g1[1], g2[1];
+   bool b1, b2;
+   stats_t stats[1];
+
+   in_file_1 = NULL;
+   in_file_2 = NULL;
+   out_file = NULL;
+
+   Summary = FALSE;
+   Threshold = 10.0;
+
+   for (i = 1; i < argc; i++) {
+
+      if (FALSE) {
+
+      } else if (my_string_equal(argv[i],"diff-book")) {
+
+         // skip
+
+      } else if (my_string_equal(argv[i],"-in1")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_diff(): missing argument\n");
+
+         in_file_1 = argv[i];
+
+      } else if (my_string_equal(argv[i],"-in2")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_diff(): missing argument\n");
+
+         in_file_2 = argv[i];
+
+      } else if (my_string_equal(argv[i],"-out")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_diff(): missing argument\n");
+
+         out_file = argv[i];
+
+      } else if (my_string_equal(argv[i],"-threshold")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_diff(): missing argument\n");
+
+         Threshold = atof(argv[i]);
+         if (Threshold < 0.0) my_fatal("book_diff(): bad threshold\n");
+
+      } else if (my_string_equal(argv[i],"-summary")) {
+
+         Summary = TRUE;
+
+      } else {
+
+         my_fatal("book_diff(): unknown option \"%s\"\n",argv[i]);
+      }
+   }
+
+   if (in_file_1 == NULL || in_file_2 == NULL) {
+      my_fatal("book_diff(): you must give -in1 and -in2\n");
+   }
+
+   book_open(In1,in_file_1);
+   book_open(In2,in_file_2);
+
+   if (out_file == NULL) {
+      Out = stdout;
+   } else if ((Out = fopen(out_file,"w")) == NULL) {
+      my_fatal("book_diff(): can't open file \"%s\" for writing: %s\n",out_file,strerror(errno));
+   }
+
+   memset(stats,0,sizeof(stats_t));
+
+   group_init(g1);
+   group_init(g2);
+
+   // merge-join on the key, both books are read once in order
+
+   b1 = read_group(In1,g1);
+   b2 = read_group(In2,g2);
+
+   while (b1 || b2) {
+
+      if (b1 && (!b2 || g1->entry[0].key < g2->entry[0].key)) {
+
+         report_group("-pos",g1);
+         stats->pos_1++;
+         stats->pos_removed++;
+         b1 = read_group(In1,g1);
+
+      } else if (b2 && (!b1 || g2->entry[0].key < g1->entry[0].key)) {
+
+         report_group("+pos",g2);
+         stats->pos_2++;
+         stats->pos_added++;
+         b2 = read_group(In2,g2);
+
+      } else {
+
+         ASSERT(g1->entry[0].key==g2->entry[0].key);
+
+         diff_position(g1,g2,stats);
+         stats->pos_1++;
+         stats->pos_2++;
+         stats->pos_common++;
+         b1 = read_group(In1,g1);
+         b2 = read_group(In2,g2);
+      }
+   }
+
+   group_free(g1);
+   group_free(g2);
+
+   book_close(In1);
+   book_close(In2);
+
+   fprintf(Out,"positions: %d -> %d (%d common, %d added, %d removed)\n",
+           stats->pos_1,stats->pos_2,stats->pos_common,stats->pos_added,stats->pos_removed);
+   fprintf(Out,"moves in common positions: %d added, %d removed, %d changed by more than %g%%\n",
+           stats->move_added,stats->move_removed,stats->move_changed,Threshold);
+
+   if (fflush(Out) == EOF) my_fatal("book_diff(): fflush(): %s\n",strerror(errno));
+   if (Out != stdout) fclose(Out);
+}
+
+// diff_position()
+
+static void diff_position(const group_t * g1, const group_t * g2, stats_t * stats) {
+
+   char move_string[16];
+   double share_1, share_2;
+   int i, j;
+
+   ASSERT(g1!=NULL);
+   ASSERT(g2!=NULL);
+   ASSERT(stats!=NULL);
+
+   // a position has few moves, the quadratic match is cheaper than sorting
+
+   for (i = 0; i < g1->size; i++) {
+
+      for (j = 0; j < g2->size; j++) {
+         if (g2->entry[j].move == g1->entry[i].move) break;
+      }
+
+      move_to_coord(g1->entry[i].move,move_string);
+
+      if (j == g2->size) {
+
+         stats->move_removed++;
+         if (!Summary) fprintf(Out,"-move " U64_FORMAT " %s %d\n",g1->entry[i].key,move_string,g1->entry[i].count);
+
+      } else {
+
+         // weights only mean something relative to the position, the
+         // change is measured against the old share (any change from 0)
+
+         share_1 = share(g1,i);
+         share_2 = share(g2,j);
+
+         if (share_2 != share_1 && (share_1 == 0.0 || fabs(share_2-share_1) > share_1 * Threshold / 100.0)) {
+            stats->move_changed++;
+            if (!Summary) fprintf(Out,"~move " U64_FORMAT " %s %.1f%% -> %.1f%%\n",g1->entry[i].key,move_string,share_1,share_2);
+         }
+      }
+   }
+
+   for (j = 0; j < g2->size; j++) {
+
+      for (i = 0; i < g1->size; i++) {
+         if (g1->entry[i].move == g2->entry[j].move) break;
+      }
+
+      if (i == g1->size) {
+         stats->move_added++;
+         move_to_coord(g2->entry[j].move,move_string);
+         if (!Summary) fprintf(Out,"+move " U64_FORMAT " %s %d\n",g2->entry[j].key,move_string,g2->entry[j].count);
+      }
+   }
+}
+
+// report_group()
+
+static void report_group(const char tag[], const group_t * group) {
+
+   char move_string[16];
+   int i;
+
+   ASSERT(tag!=NULL);
+   ASSERT(group!=NULL);
+   ASSERT(group->size>0);
+
+   if (Summary) return;
+
+   fprintf(Out,"%s " U64_FORMAT,tag,group->entry[0].key);
+
+   for (i = 0; i < group->size; i++) {
+      move_to_coord(group->entry[i].move,move_string);
+      fprintf(Out," %s %d",move_string,group->entry[i].count);
+   }
+
+   fprintf(Out,"\n");
+}
+
+// share()
+
+static double share(const group_t * group, int i) {
+
+   ASSERT(group!=NULL);
+   ASSERT(i>=0&&i<group->size);
+
+   if (group->total == 0) return 0.0;
+
+   return (100.0 * group->entry[i].count) / group->total;
+}
+
+// book_open()
+
+static void book_open(book_t * book, const char file_name[]) {
+
+   ASSERT(book!=NULL);
+   ASSERT(file_name!=NULL);
+
+   book->file = fopen(file_name,"rb");
+   if (book->file == NULL) my_fatal("book_open(): can't open file \"%s\": %s\n",file_name,strerror(errno));
+
+   if (book_pack_detect(book->file)) {
+      my_fatal("book_open(): \"%s\" is packed, run unpack-book first\n",file_name);
+   }
+
+   if (fseek(book->file,0,SEEK_END) == -1) {
+      my_fatal("book_open(): fseek(): %s\n",strerror(errno));
+   }
+
+   book->size = ftell(book->file) / 16;
+
+   if (fseek(book->file,0,SEEK_SET) == -1) {
+      my_fatal("book_open(): fseek(): %s\n",strerror(errno));
+   }
+
+   // one pass front to back, in large blocks
+
+   setvbuf(book->file,NULL,_IOFBF,ReadBufferSize);
+
+   book->pos = 0;
+   book->next_ok = read_entry(book,book->next);
+}
+
+// book_close()
+
+static void book_close(book_t * book) {
+
+   ASSERT(book!=NULL);
+
+   if (fclose(book->file) == EOF) {
+      my_fatal("book_close(): fclose(): %s\n",strerror(errno));
+   }
+}
+
+// read_group()
+
+static bool read_group(book_t * book, group_t * group) {
+
+   ASSERT(book!=NULL);
+   ASSERT(group!=NULL);
+
+   // all the entries of the next position, skipping the header
+
+   while (book->next_ok && book->next->key == U64(0x0)) {
+      book->next_ok = read_entry(book,book->next);
+   }
+
+   if (!book->next_ok) return FALSE;
+
+   group->size = 0;
+   group->total = 0;
+
+   do {
+      group_add(group,book->next);
+      book->next_ok = read_entry(book,book->next);
+   } while (book->next_ok && book->next->key == group->entry[0].key);
+
+   // the join is only right on sorted books
+
+   if (book->next_ok && book->next->key < group->entry[0].key) {
+      my_fatal("read_group(): book not sorted at entry %d\n",book->pos-1);
+   }
+
+   return TRUE;
+}
+
+// read_entry()
+
+static bool read_entry(book_t * book, entry_t * entry) {
+
+   uint8 buffer[16];
+   uint64 key;
+   int i;
+
+   ASSERT(book!=NULL);
+   ASSERT(entry!=NULL);
+
+   if (book->pos >= book->size) return FALSE;
+
+   if (fread(buffer,1,16,book->file) != 16) {
+      my_fatal("read_entry(): fread(): %s\n",strerror(errno));
+   }
+
+   book->pos++;
+
+   key = 0;
+   for (i = 0; i < 8; i++) key = (key << 8) | buffer[i];
+
+   entry->key   = key;
+   entry->move  = (buffer[8] << 8) | buffer[9];
+   entry->count = (buffer[10] << 8) | buffer[11];
+   entry->n     = (buffer[12] << 8) | buffer[13];
+   entry->sum   = (buffer[14] << 8) | buffer[15];
+
+   return TRUE;
+}
+
+// group_init()
+
+static void group_init(group_t * group) {
+
+   ASSERT(group!=NULL);
+
+   group->alloc = 64;
+   group->entry = (entry_t *) my_malloc(group->alloc*sizeof(entry_t));
+   group->size = 0;
+   group->total = 0;
+}
+
+// group_free()
+
+static void group_free(group_t * group) {
+
+   ASSERT(group!=NULL);
+
+   my_free(group->entry);
+   group->entry = NULL;
+}
+
+// group_add()
+
+static void group_add(group_t * group, const entry_t * entry) {
+
+   ASSERT(group!=NULL);
+   ASSERT(entry!=NULL);
+
+   if (group->size == group->alloc) {
+      group->alloc *= 2;
+      group->entry = (entry_t *) my_realloc(group->entry,group->alloc*sizeof(entry_t));
+   }
+
+   group->entry[group->size++] = *entry;
+   group->total += entry->count;
+}
+
+// end of book_diff.c
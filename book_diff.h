@@ -0,0 +1,17 @@
+
+// book_diff.h
+
+#ifndef BOOK_DIFF_H
+#define BOOK_DIFF_H
+
+// includes
+
+#include "util.h"
+
+// functions
+
+extern void book_diff (int argc, char * argv[]);
+
+#endif // !defined BOOK_DIFF_H
+
+// end of book_diff.h
@@ -0,0 +1,300 @@
+
+// book_estimate.c
+
+// dry run of MakeBook: the games are replayed as for a build, but positions
+// and (position, move) pairs only go through HyperLogLog sketches, and a
+// hash-selected sample of pairs keeps exact statistics for the -min-game
+// projections
+
+// includes
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "board.h"
+#include "book_estimate.h"
+#include "book_make.h"
+#include "hash.h"
+#include "hll.h"
+#include "move.h"
+#include "move_do.h"
+#include "move_legal.h"
+#include "pgn.h"
+#include "san.h"
+#include "util.h"
+
+// constants
+
+#define SampleMax (1<<16) // pairs with exact statistics
+#define SampleSize (SampleMax*2)
+
+static const int Threshold[] = { 1, 2, 3, 4, 5, 10, 20, 50, 100, 0 };
+
+// types
+
+typedef struct {
+   uint64 hash; // 0 for an empty slot
+   uint32 n;
+   uint32 sum;
+} sample_t;
+
+// variables
+
+static int MaxPly;
+
+static hll_t Positions[1];
+static hll_t Entries[1];
+
+static sample_t * Sample;
+static int SampleNb;
+static int Level; // pairs whose hash has this many leading zeros are sampled
+
+// prototypes
+
+static void   sample_add    (uint64 hash, int result);
+static void   sample_insert (const sample_t * sample);
+static void   sample_raise  ();
+static double sample_kept   (int min_game);
+
+// functions
+
+// book_estimate()
+
+void book_estimate(int argc, char * argv[]) {
+
+   const char * pgn_file;
+   int min_game;
+   pgn_t pgn[1];
+   board_t board[1];
+   char string[256];
+   int move;
+   int ply;
+   int result;
+   double move_nb;
+   double position_nb, entry_nb;
+   double kept;
+   int i;
+
+   pgn_file = "book.pgn";
+   MaxPly = 1024;
+   min_game = 3;
+
+   for (i = 1; i < argc; i++) {
+
+      if (FALSE) {
+
+      } else if (my_string_equal(argv[i],"estimate-book")) {
+
+         // skip
+
+      } else if (my_string_equal(argv[i],"-pgn")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_estimate(): missing argument\n");
+
+         pgn_file = argv[i];
+
+      } else if (my_string_equal(argv[i],"-max-ply")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_estimate(): missing argument\n");
+
+         MaxPly = atoi(argv[i]);
+         if (MaxPly < 0) my_fatal("book_estimate(): bad max ply\n");
+
+      } else if (my_string_equal(argv[i],"-min-game")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_estimate(): missing argument\n");
+
+         min_game = atoi(argv[i]);
+         if (min_game < 1) my_fatal("book_estimate(): bad min game\n");
+
+      } else {
+
+         my_fatal("book_estimate(): unknown option \"%s\"\n",argv[i]);
+      }
+   }
+
+   hll_clear(Positions);
+   hll_clear(Entries);
+   hll_init(Positions,HllBits);
+   hll_init(Entries,HllBits);
+
+   Sample = (sample_t *) my_malloc(SampleSize*sizeof(sample_t));
+   memset(Sample,0,SampleSize*sizeof(sample_t));
+   SampleNb = 0;
+   Level = 0;
+
+   // same replay as MakeBook's book_insert()
+
+   move_nb = 0.0;
+
+   pgn->game_nb = 1;
+   pgn_open(pgn,pgn_file);
+
+   while (pgn_next_game(pgn)) {
+
+      board_start(board);
+      ply = 0;
+      result = 0;
+
+      if (FALSE) {
+      } else if (my_string_equal(pgn->result,"1-0")) {
+         result = +1;
+      } else if (my_string_equal(pgn->result,"0-1")) {
+         result = -1;
+      }
+
+      while (pgn_next_move(pgn,string,256)) {
+
+         if (ply < MaxPly) {
+
+            move = move_from_san(string,board);
+
+            if (move == MoveNone || !move_is_legal(move,board)) {
+               my_fatal("book_estimate(): illegal move \"%s\" at line %d, column %d,game %d\n",string,pgn->move_line,pgn->move_column,pgn->game_nb);
+            }
+
+            hll_add(Positions,board->key);
+            hll_add(Entries,hash_pair_key(board->key,move));
+
+            sample_add(hash_mix_64(hash_pair_key(board->key,move)),result);
+
+            move_do(board,move);
+            ply++;
+            result = -result;
+            move_nb++;
+         }
+      }
+
+      pgn->game_nb++;
+      if (pgn->game_nb % 10000 == 0) printf("%d games ...\n",pgn->game_nb);
+   }
+
+   pgn_close(pgn);
+
+   // report
+
+   position_nb = hll_count(Positions);
+   entry_nb = hll_count(Entries);
+
+   printf("Games                          : %8d\n",pgn->game_nb-1);
+   printf("Moves replayed                 : %8.0f\n",move_nb);
+   printf("Distinct positions (est.)      : %8.0f\n",position_nb);
+   printf("Distinct entries (est.)        : %8.0f\n",entry_nb);
+
+   for (i = 0; Threshold[i] != 0; i++) {
+      printf("Entries kept with -min-game %-3d: %8.0f\n",Threshold[i],entry_nb*sample_kept(Threshold[i]));
+   }
+
+   kept = entry_nb * sample_kept(min_game);
+
+   printf("Build memory (MB)              : %8.1f\n",book_make_memory(my_round(entry_nb))/1048576.0);
+   printf("Output (MB) with -min-game %-3d : %8.1f\n",min_game,kept*16.0/1048576.0);
+
+   hll_free(Positions);
+   hll_free(Entries);
+   my_free(Sample);
+}
+
+// sample_add()
+
+static void sample_add(uint64 hash, int result) {
+
+   sample_t sample[1];
+   int index;
+
+   ASSERT(result>=-1&&result<=+1);
+
+   if (hash == U64(0x0)) hash = 1;
+
+   // one pair in 2^Level, always the same ones
+
+   if (Level != 0 && (hash >> (64 - Level)) != 0) return;
+
+   for (index = (int) (hash & (SampleSize-1)); Sample[index].hash != U64(0x0); index = (index+1) & (SampleSize-1)) {
+      if (Sample[index].hash == hash) {
+         Sample[index].n++;
+         Sample[index].sum += result+1;
+         return;
+      }
+   }
+
+   sample->hash = hash;
+   sample->n = 1;
+   sample->sum = result+1;
+
+   Sample[index] = *sample;
+   SampleNb++;
+
+   if (SampleNb > SampleMax) sample_raise();
+}
+
+// sample_insert()
+
+static void sample_insert(const sample_t * sample) {
+
+   int index;
+
+   ASSERT(sample!=NULL);
+
+   for (index = (int) (sample->hash & (SampleSize-1)); Sample[index].hash != U64(0x0); index = (index+1) & (SampleSize-1))
+      ;
+
+   Sample[index] = *sample;
+   SampleNb++;
+}
+
+// sample_raise()
+
+static void sample_raise() {
+
+   sample_t * old;
+   int index;
+
+   // halve the sampling rate, keeping the pairs that still qualify
+
+   old = Sample;
+
+   Sample = (sample_t *) my_malloc(SampleSize*sizeof(sample_t));
+   memset(Sample,0,SampleSize*sizeof(sample_t));
+   SampleNb = 0;
+   Level++;
+
+   for (index = 0; index < SampleSize; index++) {
+      if (old[index].hash != U64(0x0) && (old[index].hash >> (64 - Level)) == 0) {
+         sample_insert(&old[index]);
+      }
+   }
+
+   my_free(old);
+}
+
+// sample_kept()
+
+static double sample_kept(int min_game) {
+
+   int kept;
+   int index;
+
+   ASSERT(min_game>=1);
+
+   if (SampleNb == 0) return 0.0;
+
+   // the same test as MakeBook's keep_entry() with the default -min-score
+
+   kept = 0;
+
+   for (index = 0; index < SampleSize; index++) {
+      if (Sample[index].hash != U64(0x0) && Sample[index].n >= (uint32) min_game && Sample[index].sum != 0) {
+         kept++;
+      }
+   }
+
+   return ((double)kept) / SampleNb;
+}
+
+// end of book_estimate.c
@@ -0,0 +1,17 @@
+
+// book_estimate.h
+
+#ifndef BOOK_ESTIMATE_H
+#define BOOK_ESTIMATE_H
+
+// includes
+
+#include "util.h"
+
+// functions
+
+extern void book_estimate (int argc, char * argv[]);
+
+#endif // !defined BOOK_ESTIMATE_H
+
+// end of book_estimate.h
@@ -0,0 +1,431 @@
+
+// book_export.c
+
+// includes
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "board.h"
+#include "book.h"
+#include "book_export.h"
+#include "book_walk.h"
+#include "fen.h"
+#include "move.h"
+#include "move_legal.h"
+#include "option.h"
+#include "san.h"
+#include "thread.h"
+#include "util.h"
+
+// constants
+
+#define ChunkSize        4096 // entries
+#define WindowFactor     4    // chunks in flight per thread
+#define LineSize         1024
+#define OutputBufferSize (1<<20)
+
+// types
+
+enum format_t {
+   FORMAT_CSV,
+   FORMAT_JSONL,
+   FORMAT_EPD
+};
+
+typedef struct {
+   char * data;
+   int size;
+   int alloc;
+   bool done;
+   int record_nb;
+   int skip_nb;
+} chunk_t;
+
+// variables
+
+static book_file_t Book[1];
+static book_walk_t Walk[1];
+static int Format;
+
+static int ChunkNb;
+static int ChunkNext;
+static int ChunkBase;
+static int WindowSize;
+static chunk_t * Window;
+
+static my_mutex_t ChunkMutex[1];
+static my_cond_t ChunkCond[1];
+
+// prototypes
+
+static void exporter      (void * arg);
+static void chunk_format  (chunk_t * chunk, int first, int last);
+static int  chunk_start   (int chunk);
+static void chunk_add     (chunk_t * chunk, const char string[]);
+
+
+// functions
+
+// book_export()
+
+void book_export(int argc, char * argv[]) {
+
+   const char * bin_file;
+   const char * out_file;
+   int thread_nb;
+   my_thread_t * thread;
+   FILE * out;
+   chunk_t * chunk;
+   int record_nb, skip_nb;
+   int i;
+
+   bin_file = "book.bin";
+   out_file = NULL;
+   Format = FORMAT_CSV;
+   thread_nb = my_cpu_nb();
+
+   for (i = 1; i < argc; i++) {
+
+      if (FALSE) {
+
+      } else if (my_string_equal(argv[i],"export-book")) {
+
+         // skip
+
+      } else if (my_string_equal(argv[i],"-bin")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_export(): missing argument\n");
+
+         bin_file = argv[i];
+
+      } else if (my_string_equal(argv[i],"-out")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_export(): missing argument\n");
+
+         out_file = argv[i];
+
+      } else if (my_string_equal(argv[i],"-format")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_export(): missing argument\n");
+
+         if (my_string_equal(argv[i],"csv")) {
+            Format = FORMAT_CSV;
+         } else if (my_string_equal(argv[i],"jsonl")) {
+            Format = FORMAT_JSONL;
+         } else if (my_string_equal(argv[i],"epd")) {
+            Format = FORMAT_EPD;
+         } else {
+            my_fatal("book_export(): unknown format \"%s\"\n",argv[i]);
+         }
+
+      } else if (my_string_equal(argv[i],"-threads")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_export(): missing argument\n");
+
+         thread_nb = atoi(argv[i]);
+         if (thread_nb < 1) my_fatal("book_export(): bad thread number\n");
+
+      } else {
+
+         my_fatal("book_export(): unknown option \"%s\"\n",argv[i]);
+      }
+   }
+
+   option_init_pg(); // move_to_can() reads UCI_Chess960
+
+   if (!book_file_open(Book,bin_file)) {
+      my_fatal("book_export(): can't open book \"%s\"\n",bin_file);
+      return;
+   }
+
+   if (Book->pack->data != NULL && book_pack_check(Book->pack) != 0) {
+      my_fatal("book_export(): \"%s\" is corrupted, run verify-book\n",bin_file);
+      book_file_close(Book);
+      return;
+   }
+
+   // entries are read from memory by all the threads at once
+
+   if (Book->data == NULL) book_file_copy(Book);
+
+   if (out_file == NULL) {
+      out = stdout;
+   } else if ((out = fopen(out_file,"w")) == NULL) {
+      my_fatal("book_export(): can't open file \"%s\" for writing: %s\n",out_file,strerror(errno));
+   }
+
+   setvbuf(out,NULL,_IOFBF,OutputBufferSize);
+
+   // positions get a FEN and SAN only when reachable from the start
+
+   book_walk_build(Walk,Book);
+
+   if (Format == FORMAT_CSV) fprintf(out,"key,fen,uci,san,weight,n,sum\n");
+
+   // chunks are formatted in parallel and written in book order
+
+   ChunkNb = (Book->size + ChunkSize - 1) / ChunkSize;
+   ChunkNext = 0;
+   ChunkBase = 0;
+   WindowSize = WindowFactor * thread_nb;
+   Window = (chunk_t *) my_malloc(WindowSize*sizeof(chunk_t));
+   memset(Window,0,WindowSize*sizeof(chunk_t));
+
+   my_mutex_init(ChunkMutex);
+   my_cond_init(ChunkCond);
+
+   thread = (my_thread_t *) my_malloc(thread_nb*sizeof(my_thread_t));
+   for (i = 0; i < thread_nb; i++) my_thread_create(&thread[i],exporter,NULL);
+
+   record_nb = 0;
+   skip_nb = 0;
+
+   while (ChunkBase < ChunkNb) {
+
+      chunk = &Window[ChunkBase%WindowSize];
+
+      my_mutex_lock(ChunkMutex);
+      while (!chunk->done) my_cond_wait(ChunkCond,ChunkMutex);
+      my_mutex_unlock(ChunkMutex);
+
+      if (chunk->size != 0 && fwrite(chunk->data,1,chunk->size,out) != (size_t)chunk->size) {
+         my_fatal("book_export(): fwrite(): %s\n",strerror(errno));
+      }
+
+      record_nb += chunk->record_nb;
+      skip_nb += chunk->skip_nb;
+
+      my_mutex_lock(ChunkMutex);
+      chunk->done = FALSE;
+      chunk->size = 0;
+      ChunkBase++;
+      my_cond_broadcast(ChunkCond);
+      my_mutex_unlock(ChunkMutex);
+   }
+
+   for (i = 0; i < thread_nb; i++) my_thread_join(&thread[i]);
+   my_free(thread);
+
+   if (fflush(out) == EOF) my_fatal("book_export(): fflush(): %s\n",strerror(errno));
+   if (out != stdout) fclose(out);
+
+   fprintf(stderr,"exported %d records, %d reachable positions",record_nb,Walk->size);
+   if (skip_nb != 0) fprintf(stderr,", %d entries without a position skipped",skip_nb);
+   fprintf(stderr,"\n");
+
+   for (i = 0; i < WindowSize; i++) {
+      if (Window[i].data != NULL) my_free(Window[i].data);
+   }
+   my_free(Window);
+
+   my_cond_free(ChunkCond);
+   my_mutex_free(ChunkMutex);
+
+   book_walk_free(Walk);
+   book_file_close(Book);
+}
+
+// exporter()
+
+static void exporter(void * arg) {
+
+   int chunk;
+
+   (void) arg; // unused
+
+   while (TRUE) {
+
+      my_mutex_lock(ChunkMutex);
+      while (ChunkNext < ChunkNb && ChunkNext >= ChunkBase + WindowSize) {
+         my_cond_wait(ChunkCond,ChunkMutex);
+      }
+      chunk = ChunkNext;
+      if (chunk < ChunkNb) ChunkNext++;
+      my_mutex_unlock(ChunkMutex);
+
+      if (chunk >= ChunkNb) break;
+
+      // the slot was released by the writer before ChunkNext could reach it
+
+      chunk_format(&Window[chunk%WindowSize],chunk_start(chunk),chunk_start(chunk+1));
+
+      my_mutex_lock(ChunkMutex);
+      Window[chunk%WindowSize].done = TRUE;
+      my_cond_broadcast(ChunkCond);
+      my_mutex_unlock(ChunkMutex);
+   }
+}
+
+// chunk_start()
+
+static int chunk_start(int chunk) {
+
+   book_entry_t entry[1], prev[1];
+   book_cache_t cache[1];
+   int pos;
+
+   // chunks end on position boundaries, each position is in one chunk
+
+   if (chunk <= 0) return 0;
+   if (chunk >= ChunkNb) return Book->size;
+
+   book_cache_clear(cache);
+
+   pos = chunk * ChunkSize;
+   if (!book_cache_read(cache,Book,prev,pos-1)) my_fatal("chunk_start(): corrupt block %d\n",(pos-1)/PackBlockSize);
+
+   for (; pos < Book->size; pos++) {
+      if (!book_cache_read(cache,Book,entry,pos)) my_fatal("chunk_start(): corrupt block %d\n",pos/PackBlockSize);
+      if (entry->key != prev->key) break;
+   }
+
+   return pos;
+}
+
+// chunk_format()
+
+static void chunk_format(chunk_t * chunk, int first, int last) {
+
+   book_entry_t entry[1];
+   book_cache_t cache[1];
+   board_t board[1];
+   char fen[256];
+   char uci[16];
+   char san[16];
+   char line[LineSize];
+   uint64 key;
+   int node;
+   bool legal;
+   int field;
+   int pos;
+   int i;
+
+   ASSERT(chunk!=NULL);
+
+   chunk->size = 0;
+   chunk->record_nb = 0;
+   chunk->skip_nb = 0;
+
+   key = U64(0x0);
+   node = -1;
+
+   book_cache_clear(cache);
+
+   for (pos = first; pos < last; pos++) {
+
+      if (!book_cache_read(cache,Book,entry,pos)) {
+         my_fatal("chunk_format(): corrupt block %d\n",pos/PackBlockSize);
+      }
+
+      if (entry->key == U64(0x0)) continue; // header
+
+      if (pos == first || entry->key != key) {
+
+         key = entry->key;
+         node = book_walk_find(Walk,key);
+
+         if (node >= 0) {
+            book_walk_board(Walk,node,board);
+            if (!board_to_fen(board,fen,256)) {
+               my_fatal("chunk_format(): board_to_fen() failed\n");
+            }
+         }
+      }
+
+      legal = node >= 0 && entry->move != MoveNone && move_is_legal(entry->move,board);
+
+      if (legal) {
+         move_to_can(entry->move,board,uci,16);
+         move_to_san(entry->move,board,san,16);
+      } else {
+         move_to_coord(entry->move,uci);
+         san[0] = '\0';
+      }
+
+      switch (Format) {
+
+      case FORMAT_CSV:
+
+         snprintf(line,LineSize,U64_FORMAT ",%s,%s,%s,%d,%d,%d\n",
+                  key,(node>=0)?fen:"",uci,san,entry->count,entry->n,entry->sum);
+         break;
+
+      case FORMAT_JSONL:
+
+         i = snprintf(line,LineSize,"{\"key\":\"" U64_FORMAT "\",",key);
+         if (node >= 0) {
+            i += snprintf(&line[i],LineSize-i,"\"fen\":\"%s\",",fen);
+         } else {
+            i += snprintf(&line[i],LineSize-i,"\"fen\":null,");
+         }
+         i += snprintf(&line[i],LineSize-i,"\"uci\":\"%s\",",uci);
+         if (legal) {
+            i += snprintf(&line[i],LineSize-i,"\"san\":\"%s\",",san);
+         } else {
+            i += snprintf(&line[i],LineSize-i,"\"san\":null,");
+         }
+         snprintf(&line[i],LineSize-i,"\"weight\":%d,\"n\":%d,\"sum\":%d}\n",
+                  entry->count,entry->n,entry->sum);
+         break;
+
+      case FORMAT_EPD:
+
+         // EPD needs the position, it is the FEN without the move counters
+
+         if (!legal) {
+            chunk->skip_nb++;
+            continue;
+         }
+
+         for (i = 0, field = 1; fen[i] != '\0'; i++) {
+            if (fen[i] == ' ' && ++field > 4) break;
+         }
+
+         snprintf(line,LineSize,"%.*s sm %s; id \"" U64_FORMAT "\"; c0 \"weight=%d n=%d sum=%d\";\n",
+                  i,fen,san,key,entry->count,entry->n,entry->sum);
+         break;
+
+      default:
+
+         ASSERT(FALSE);
+         break;
+      }
+
+      chunk_add(chunk,line);
+      chunk->record_nb++;
+   }
+}
+
+// chunk_add()
+
+static void chunk_add(chunk_t * chunk, const char string[]) {
+
+   int len;
+
+   ASSERT(chunk!=NULL);
+   ASSERT(string!=NULL);
+
+   len = strlen(string);
+
+   if (chunk->data == NULL) {
+      chunk->alloc = 65536;
+      chunk->data = (char *) my_malloc(chunk->alloc);
+   }
+
+   if (chunk->size + len > chunk->alloc) {
+      while (chunk->size + len > chunk->alloc) chunk->alloc *= 2;
+      chunk->data = (char *) my_realloc(chunk->data,chunk->alloc);
+   }
+
+   memcpy(&chunk->data[chunk->size],string,len);
+   chunk->size += len;
+}
+
+// end of book_export.c
@@ -0,0 +1,17 @@
+
+// book_export.h
+
+#ifndef BOOK_EXPORT_H
+#define BOOK_EXPORT_H
+
+// includes
+
+#include "util.h"
+
+// functions
+
+extern void book_export (int argc, char * argv[]);
+
+#endif // !defined BOOK_EXPORT_H
+
+// end of book_export.h
@@ -0,0 +1,311 @@
+
+// book_index.c
+
+// includes
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "book_index.h"
+#include "hash.h"
+#include "util.h"
+
+// constants
+
+static const char IndexMagic[] = "PGIDX002";
+
+#define DigestSampleNb 64 // entry keys a sidecar is checked against
+
+// prototypes
+
+static int    index_fill    (book_index_t * index, const uint64 key[], const sint32 pos[], int i, int k);
+static void   index_alloc   (book_index_t * index, int size);
+
+static bool   read_integer  (FILE * file, int size, uint64 * n);
+static void   write_integer (FILE * file, int size, uint64 n);
+
+// functions
+
+// book_index_clear()
+
+void book_index_clear(book_index_t * index) {
+
+   ASSERT(index!=NULL);
+
+   index->size = 0;
+   index->book_size = 0;
+   index->buffer = NULL;
+   index->key = NULL;
+   index->pos = NULL;
+}
+
+// book_index_free()
+
+void book_index_free(book_index_t * index) {
+
+   ASSERT(index!=NULL);
+
+   if (index->buffer != NULL) my_free(index->buffer);
+
+   book_index_clear(index);
+}
+
+// book_index_build()
+
+void book_index_build(book_index_t * index, const uint64 key[], const sint32 pos[], int size, int book_size) {
+
+   ASSERT(index!=NULL);
+   ASSERT(key!=NULL);
+   ASSERT(pos!=NULL);
+   ASSERT(size>=0);
+
+   // key[] is sorted, the index stores it in Eytzinger (BFS) order
+
+   book_index_free(index);
+   index_alloc(index,size);
+   index->book_size = book_size;
+
+   if (index_fill(index,key,pos,0,1) != size) {
+      my_fatal("book_index_build(): index_fill() failed\n");
+   }
+}
+
+// book_index_find()
+
+int book_index_find(const book_index_t * index, uint64 key) {
+
+   const uint64 * keys;
+   size_t n, k;
+
+   ASSERT(index!=NULL);
+
+   keys = index->key;
+   n = index->size;
+
+   // branch-free descent, the eight grand-grand-children share one cache
+   // line, the prefetch stays inside the array near the bottom
+
+   k = 1;
+
+   while (k <= n) {
+      PREFETCH(&keys[(k*8 <= n)?k*8:n]);
+      k = 2*k + (keys[k] < key);
+   }
+
+   // undo the right turns taken after the lower bound
+
+   while ((k & 1) != 0) k >>= 1;
+   k >>= 1;
+
+   if (k == 0 || keys[k] != key) return -1;
+
+   return index->pos[k];
+}
+
+// book_index_load()
+
+bool book_index_load(book_index_t * index, const char file_name[], int book_size, uint64 digest) {
+
+   FILE * file;
+   char magic[8];
+   uint64 n;
+   int size;
+   int k;
+
+   ASSERT(index!=NULL);
+   ASSERT(file_name!=NULL);
+
+   // a sidecar written for another version of the book is stale, file
+   // dates are not trusted to tell
+
+   file = fopen(file_name,"rb");
+   if (file == NULL) return FALSE;
+
+   if (fread(magic,1,8,file) != 8 || memcmp(magic,IndexMagic,8) != 0) {
+      fclose(file);
+      return FALSE;
+   }
+
+   if (!read_integer(file,8,&n) || n != (uint64) book_size) {
+      fclose(file);
+      return FALSE;
+   }
+
+   if (!read_integer(file,8,&n) || n != digest) {
+      fclose(file);
+      return FALSE;
+   }
+
+   if (!read_integer(file,8,&n) || n > (uint64) book_size) {
+      fclose(file);
+      return FALSE;
+   }
+
+   size = (int) n;
+
+   book_index_free(index);
+   index_alloc(index,size);
+   index->book_size = book_size;
+
+   for (k = 1; k <= size; k++) {
+      if (!read_integer(file,8,&n)) break;
+      index->key[k] = n;
+      if (!read_integer(file,4,&n)) break;
+      index->pos[k] = (sint32) n;
+   }
+
+   fclose(file);
+
+   if (k <= size) {
+      book_index_free(index);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+// book_index_save()
+
+void book_index_save(const book_index_t * index, const char file_name[], uint64 digest) {
+
+   FILE * file;
+   int k;
+
+   ASSERT(index!=NULL);
+   ASSERT(file_name!=NULL);
+
+   file = fopen(file_name,"wb");
+   if (file == NULL) my_fatal("book_index_save(): can't open file \"%s\" for writing: %s\n",file_name,strerror(errno));
+
+   fwrite(IndexMagic,1,8,file);
+   write_integer(file,8,index->book_size);
+   write_integer(file,8,digest);
+   write_integer(file,8,index->size);
+
+   for (k = 1; k <= index->size; k++) {
+      write_integer(file,8,index->key[k]);
+      write_integer(file,4,(uint32)index->pos[k]);
+   }
+
+   if (fclose(file) == EOF) {
+      my_fatal("book_index_save(): fclose(): %s\n",strerror(errno));
+   }
+}
+
+// book_digest()
+
+uint64 book_digest(book_key_func_t key_func, const void * book, int book_size) {
+
+   uint64 digest;
+   int i;
+
+   ASSERT(key_func!=NULL);
+   ASSERT(book_size>=0);
+
+   // the size and keys spread over the whole book, first and last
+   // included, a few reads that tell a sidecar's book from another
+
+   digest = hash_mix_64((uint64)book_size);
+
+   for (i = 0; i < DigestSampleNb && book_size > 0; i++) {
+      digest = hash_mix_64(digest ^ key_func(book,(int)(((sint64)(book_size-1) * i) / (DigestSampleNb-1))));
+   }
+
+   return digest;
+}
+
+// index_fill()
+
+static int index_fill(book_index_t * index, const uint64 key[], const sint32 pos[], int i, int k) {
+
+   ASSERT(index!=NULL);
+
+   // in-order walk of the implicit tree
+
+   if (k <= index->size) {
+      i = index_fill(index,key,pos,i,2*k);
+      index->key[k] = key[i];
+      index->pos[k] = pos[i];
+      i = index_fill(index,key,pos,i+1,2*k+1);
+   }
+
+   return i;
+}
+
+// index_alloc()
+
+static void index_alloc(book_index_t * index, int size) {
+
+   size_t key_size;
+   char * address;
+
+   ASSERT(index!=NULL);
+   ASSERT(size>=0);
+
+   // slot 0 is unused, keys start on a cache line boundary
+
+   key_size = (size+1) * sizeof(uint64);
+
+   index->buffer = my_malloc(64+key_size+(size+1)*sizeof(sint32));
+
+   address = (char *) index->buffer;
+   address += (64 - ((size_t)address & 63)) & 63;
+
+   index->size = size;
+   index->key = (uint64 *) address;
+   index->pos = (sint32 *) (address + key_size);
+
+   index->key[0] = 0;
+   index->pos[0] = -1;
+}
+
+// read_integer()
+
+static bool read_integer(FILE * file, int size, uint64 * n) {
+
+   int i;
+   int b;
+
+   ASSERT(file!=NULL);
+   ASSERT(size>0&&size<=8);
+   ASSERT(n!=NULL);
+
+   *n = 0;
+
+   for (i = 0; i < size; i++) {
+
+      b = fgetc(file);
+      if (b == EOF) return FALSE;
+
+      ASSERT(b>=0&&b<256);
+      *n = (*n << 8) | b;
+   }
+
+   return TRUE;
+}
+
+// write_integer()
+
+static void write_integer(FILE * file, int size, uint64 n) {
+
+   int i;
+   int b;
+
+   ASSERT(file!=NULL);
+   ASSERT(size>0&&size<=8);
+   ASSERT(size==8||n>>(size*8)==0);
+
+   for (i = size-1; i >= 0; i--) {
+
+      b = (n >> (i*8)) & 0xFF;
+      ASSERT(b>=0&&b<256);
+
+      if (fputc(b,file) == EOF) {
+         my_fatal("write_integer(): fputc(): %s\n",strerror(errno));
+      }
+   }
+}
+
+// end of book_index.c
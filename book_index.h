@@ -0,0 +1,38 @@
+
+// book_index.h
+
+#ifndef BOOK_INDEX_H
+#define BOOK_INDEX_H
+
+// includes
+
+#include "util.h"
+
+// types
+
+typedef uint64 (*book_key_func_t) (const void * book, int pos);
+
+typedef struct {
+   int size;
+   int book_size;
+   void * buffer;
+   uint64 * key;
+   sint32 * pos;
+} book_index_t;
+
+// functions
+
+extern void book_index_clear (book_index_t * index);
+extern void book_index_free  (book_index_t * index);
+
+extern void book_index_build (book_index_t * index, const uint64 key[], const sint32 pos[], int size, int book_size);
+extern int  book_index_find  (const book_index_t * index, uint64 key);
+
+extern bool book_index_load  (book_index_t * index, const char file_name[], int book_size, uint64 digest);
+extern void book_index_save  (const book_index_t * index, const char file_name[], uint64 digest);
+
+extern uint64 book_digest    (book_key_func_t key_func, const void * book, int book_size);
+
+#endif // !defined BOOK_INDEX_H
+
+// end of book_index.h
@@ -4,20 +4,53 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(BOOK_BUCKETS) && defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+#include "attack.h"
+#include "bloom.h"
+#include "cms.h"
 #include "board.h"
 #include "book_make.h"
+#include "book_pack.h"
+#include "hash.h"
+#include "huge.h"
 #include "move.h"
 #include "move_do.h"
 #include "move_gen.h"
 #include "move_legal.h"
 #include "pgn.h"
+#include "pgn_pipe.h"
 #include "san.h"
+#include "thread.h"
 #include "util.h"
 #include "pgheader.h"
 
 // constants
 
-#define COUNT_MAX ((int)16384)
+#define FilterProbeNb 1000000
+
+#define ShardNb    64
+#define ShardShift 58
+
+#define StealNb 16
+
+#define PlyStringSize 32
+#define OutputBufferSize (1<<20)
+
+#define SampleSize  (1<<20) // PGN bytes read before the first size sample
+#define MigrateStep 2       // entries moved to the grown hash table per probe
+#define AllocMax    (1<<29)
+#define BatchSize   16      // moves whose table slots are fetched together
+#define SpecMax     16      // books written from one pass
+#define CountMax    0xFFFFFFFF // n and sum stop short of wrapping
+
+#ifdef BOOK_BUCKETS
+#  define BucketSize 12     // entries per 64-byte bucket
+#  define BucketFull ((1<<BucketSize)-1)
+#  define PAIR_TAG(pair) (0x80|(int)((pair)>>57)) // never 0, the free tag
+#endif
 
 static const int NIL = -1;
 
@@ -39,8 +72,8 @@ typedef struct {
 // even with -Wall.
 //    union {   
 //        struct { 
-            uint16 n;
-            uint16 sum;
+            uint32 n;   // wide while building, no rescaling needed
+            uint32 sum;
 //        };
 //        struct {
             uint8 height;
@@ -50,14 +83,59 @@ typedef struct {
     uint8 colour;
 } entry_t;
 
+#ifdef BOOK_BUCKETS
+
+// one cache line: tags from the (key, move) hashes of up to
+// BucketSize entries, filled in order, and where those entries are
+
+typedef struct {
+   uint8 tag[16]; // 0 when free, only BucketSize are used
+   sint32 pos[BucketSize];
+} bucket_t;
+
+#endif
+
 typedef struct {
    int size;
    int alloc;
    uint32 mask;
    entry_t * entry;
+#ifdef BOOK_BUCKETS
+   bucket_t * bucket;
+   uint32 old_mask;
+   bucket_t * old_bucket; // being emptied into bucket, NULL when done
+   int migrate;           // old buckets below are in bucket
+#else
    sint32 * hash;
+   uint32 old_mask;
+   sint32 * old_hash; // being emptied into hash, NULL when done
+   int migrate;       // entries below are in hash
+   int migrate_end;   // entries below are in old_hash
+#endif
 } book_t;
 
+// the options of one output book, each MakeBook -and starts another
+
+typedef struct {
+   const char * bin_file;
+   int max_ply;
+   int min_game;
+   double min_score;
+   bool remove_white, remove_black;
+   bool uniform;
+   bool packed;
+   int level; // counts within max_ply, -1 for the table's own
+} spec_t;
+
+// counts of the moves played before ply max_ply, for books with a
+// lower -max-ply than the table was built with
+
+typedef struct {
+   int max_ply;
+   uint32 * n;
+   uint32 * sum;
+} level_t;
+
 typedef enum {
     BOOK,
     ALL
@@ -67,14 +145,65 @@ typedef struct {
     int height;
     int line;
     int initial_color;
-    bool book_trans_only;
-    bool extended_search;
-    uint16 moves[1024];
-    double probs[1024];
+    char prefix[1024*PlyStringSize];
+    int prefix_size[1024+1];
     uint64 keys[1024];
     FILE *output;
 } info_t;
 
+typedef struct {
+    uint32 mask;
+    int size;
+    bool zero;
+    uint64 * key;
+} key_set_t;
+
+typedef struct {
+    uint16 move;
+    char san[8];
+    int child;
+    double prob;
+} edge_t;
+
+typedef struct {
+    uint64 key;
+    edge_t * edge;
+    int edge_nb;
+    int line;
+    int height;
+} node_t;
+
+typedef struct {
+    board_t board[1];
+    int node;
+    search_t search;
+    bool root;
+} task_t;
+
+typedef struct {
+    my_mutex_t mutex[1];
+    uint32 mask;
+    int size;
+    uint64 * key;
+    sint32 * node;
+} shard_t;
+
+typedef struct {
+    int visit_nb;
+    int node_nb;
+    int leaf_nb;
+    int book_nb;
+} tree_t;
+
+typedef struct {
+    my_mutex_t mutex[1];
+    my_thread_t thread;
+    task_t * task;
+    int head;
+    int size;
+    int alloc;
+    tree_t tree[1];
+} walker_t;
 
 // variables
 
@@ -83,25 +212,77 @@ static int MinGame;
 static double MinScore;
 static bool RemoveWhite, RemoveBlack;
 static bool Uniform;
+static bool Packed;
+static double SketchMemory;
+static cms_t Sketch[1];
+static int ThreadNb;
+static bool Verbose;
+
+static double FileSize;
+static double SampleBytes;
+static int SampleEntries;
+static int GatedNb;
+static int GameNb;
 static bool Quiet=FALSE;
 
 static book_t Book[1];
 
+static spec_t Spec[SpecMax];
+static int SpecNb;
+static level_t Level[SpecMax];
+static int LevelNb;
+static key_set_t BookKeys[1];
+static bloom_t BookFilter[1];
+
+static shard_t Shard[ShardNb];
+static walker_t * Walker;
+static int WalkerNb;
+static volatile int TaskNb;
+static volatile int NodeNb;
+static node_t * Node;
+static int NodeAlloc;
+static bool Extended;
+
 // prototypes
 
 static void   book_clear    ();
-static void   book_insert   (const char file_name[]);
-static void   book_filter   ();
-static void   book_sort     ();
-static void   book_save     (const char file_name[]);
-
-static int    find_entry    (const board_t * board, int move);
-static void   resize        ();
-static void   halve_stats   (uint64 key);
-
-static bool   keep_entry    (int pos);
-
-static int    entry_score    (const entry_t * entry);
+static void   book_count    (const pgn_pipe_files_t * files);
+static void   book_insert   (const pgn_pipe_files_t * files);
+static void   count_moves   (const pgn_pipe_move_t move[], int move_nb, const pgn_pipe_pos_t * pos, void * arg);
+static void   insert_moves  (const pgn_pipe_move_t move[], int move_nb, const pgn_pipe_pos_t * pos, void * arg);
+static void   print_games   (const pgn_pipe_pos_t * pos);
+static void   spec_parse    (spec_t * spec, char * argv[], int * i);
+static void   spec_apply    (const spec_t * spec);
+static void   level_init    ();
+
+static int    book_filter   (entry_t output[], int level);
+static void   book_sort     (entry_t entry[], int size);
+static void   book_save     (entry_t entry_list[], int entry_nb, const char file_name[]);
+
+static void   book_add      (const pgn_pipe_move_t move[], int move_nb);
+static int    find_entry    (uint64 key, int move, int colour);
+static void   resize        (int alloc);
+static void   book_reserve  (int size);
+
+static int    hash_size     (int alloc);
+static void   hash_prefetch (uint64 key, int move, int stage);
+static int    hash_find     (uint64 key, int move);
+static int    hash_first    (uint64 key);
+static void   hash_insert   (int pos);
+static void   hash_migrate  (int step);
+#ifdef BOOK_BUCKETS
+static int    bucket_find   (const bucket_t table[], uint32 mask, int skip, uint64 pair, uint64 key, int move);
+static void   bucket_insert (bucket_t table[], uint32 mask, uint64 pair, int pos);
+static int    bucket_match  (const bucket_t * bucket, int tag);
+#endif
+static int    estimate_size (double bytes, int size_1, double bytes_1, int size_2, double bytes_2);
+static void   print_memory  ();
+
+static bool   keep_entry    (const entry_t * entry);
+
+static void   count_game     (uint32 * n, uint32 * sum, int points);
+static uint32 entry_score    (const entry_t * entry);
+static int    entry_weight   (const entry_t * entry, uint32 max);
 
 static int    key_compare   (const void * p1, const void * p2);
 
@@ -111,24 +292,46 @@ static uint64 read_integer(FILE * file, int size);
 static void read_entry_file(FILE *f, entry_t *entry);
 static void write_entry_file(FILE * f, const entry_t * entry);
 
+static void   key_set_init   (key_set_t * set, int size);
+static void   key_set_free   (key_set_t * set);
+static bool   key_set_insert (key_set_t * set, uint64 key);
+static bool   key_set_find   (const key_set_t * set, uint64 key);
+
+static void   walk_book      (tree_t * tree, int colour, bool extended, bool graph, int thread_nb);
+static void   walk_free      ();
+static bool   walk_insert    (uint64 key, int * id);
+static void   walk_expand    (walker_t * walker, const task_t * task);
+
+static void   walker_loop    (void * arg);
+static void   walker_push    (walker_t * walker, const task_t * task, int task_nb);
+static void   walker_reserve (walker_t * walker, int task_nb);
+
 void book_make(int argc, char * argv[])
 {
    int i;
-   const char * pgn_file;
-   const char * bin_file;
+   pgn_pipe_files_t pgn_files[1];
+   entry_t * output;
+   int size;
+
+   pgn_pipe_files_clear(pgn_files);
+
+   SpecNb = 1;
 
-   pgn_file = NULL;
-   my_string_set(&pgn_file,"book.pgn");
+   Spec->bin_file = NULL;
+   my_string_set(&Spec->bin_file,"book.bin");
 
-   bin_file = NULL;
-   my_string_set(&bin_file,"book.bin");
+   Spec->max_ply = 1024;
+   Spec->min_game = 3;
+   Spec->min_score = 0.0;
+   Spec->remove_white = FALSE;
+   Spec->remove_black = FALSE;
+   Spec->uniform = FALSE;
+   Spec->packed = FALSE;
+   Spec->level = -1;
 
-   MaxPly = 1024;
-   MinGame = 3;
-   MinScore = 0.0;
-   RemoveWhite = FALSE;
-   RemoveBlack = FALSE;
-   Uniform = FALSE;
+   SketchMemory = 0.0;
+   ThreadNb = my_cpu_nb();
+   Verbose = FALSE;
 
    for (i = 1; i < argc; i++) {
 
@@ -143,209 +346,485 @@ void book_make(int argc, char * argv[])
          i++;
          if (argv[i] == NULL) my_fatal("book_make(): missing argument\n");
 
-         my_string_set(&pgn_file,argv[i]);
+         // files, directories of .pgn files or patterns, read in turn
 
-      } else if (my_string_equal(argv[i],"-bin")) {
+         pgn_pipe_files_add(pgn_files,argv[i]);
 
-         i++;
-         if (argv[i] == NULL) my_fatal("book_make(): missing argument\n");
+      } else if (my_string_equal(argv[i],"-and")) {
 
-         my_string_set(&bin_file,argv[i]);
+         // another book from the same games, with the options of the first
 
-      } else if (my_string_equal(argv[i],"-max-ply")) {
+         if (SpecNb == SpecMax) my_fatal("book_make(): too many books\n");
 
-         i++;
-         if (argv[i] == NULL) my_fatal("book_make(): missing argument\n");
+         Spec[SpecNb] = Spec[0];
+         Spec[SpecNb].bin_file = NULL;
+         SpecNb++;
 
-         MaxPly = atoi(argv[i]);
-         ASSERT(MaxPly>=0);
-
-      } else if (my_string_equal(argv[i],"-min-game")) {
+      } else if (my_string_equal(argv[i],"-sketch")) {
 
          i++;
          if (argv[i] == NULL) my_fatal("book_make(): missing argument\n");
 
-         MinGame = atoi(argv[i]);
-         ASSERT(MinGame>0);
+         SketchMemory = atof(argv[i]) * 1048576.0;
+         if (SketchMemory <= 0.0) my_fatal("book_make(): bad sketch size\n");
 
-      } else if (my_string_equal(argv[i],"-min-score")) {
+      } else if (my_string_equal(argv[i],"-threads")) {
 
          i++;
          if (argv[i] == NULL) my_fatal("book_make(): missing argument\n");
 
-         MinScore = atof(argv[i]) / 100.0;
-         ASSERT(MinScore>=0.0&&MinScore<=1.0);
+         ThreadNb = atoi(argv[i]);
+         if (ThreadNb < 1) my_fatal("book_make(): bad thread number \"%s\"\n",argv[i]);
 
-      } else if (my_string_equal(argv[i],"-only-white")) {
+      } else if (my_string_equal(argv[i],"-verbose")) {
 
-         RemoveWhite = FALSE;
-         RemoveBlack = TRUE;
+         Verbose = TRUE;
 
-      } else if (my_string_equal(argv[i],"-only-black")) {
+      } else {
 
-         RemoveWhite = TRUE;
-         RemoveBlack = FALSE;
+         spec_parse(&Spec[SpecNb-1],argv,&i);
+      }
+   }
 
-      } else if (my_string_equal(argv[i],"-uniform")) {
+   if (pgn_files->size == 0) pgn_pipe_files_add(pgn_files,"book.pgn");
 
-         Uniform = TRUE;
+   for (i = 1; i < SpecNb; i++) {
+      if (Spec[i].bin_file == NULL) my_fatal("book_make(): no -bin for book %d\n",i+1);
+   }
 
-      } else {
+   // one pass over the games serves every book: the table counts up to
+   // the largest -max-ply and gates on the smallest -min-game
 
-         my_fatal("book_make(): unknown option \"%s\"\n",argv[i]);
-      }
+   MaxPly = 0;
+   MinGame = Spec->min_game;
+
+   for (i = 0; i < SpecNb; i++) {
+      if (Spec[i].max_ply > MaxPly) MaxPly = Spec[i].max_ply;
+      if (Spec[i].min_game < MinGame) MinGame = Spec[i].min_game;
    }
 
    book_clear();
+   level_init();
+
+   // moves seen fewer than MinGame times in the whole input are never
+   // kept, a first pass finds them so that they take no memory
+
+   cms_clear(Sketch);
+
+   if (SketchMemory != 0.0 && MinGame > 1) {
+      printf("counting moves ...\n");
+      book_count(pgn_files);
+   }
 
    printf("inserting games ...\n");
-   book_insert(pgn_file);
+   book_insert(pgn_files);
+   pgn_pipe_files_free(pgn_files);
+   cms_free(Sketch);
+   print_memory();
+
+   // the table is kept for all books but the last, which is filtered
+   // in place
+
+   output = (SpecNb > 1) ? (entry_t *) huge_malloc((Book->size+1)*sizeof(entry_t)) : NULL;
+
+   for (i = 0; i < SpecNb; i++) {
+
+      if (SpecNb > 1) printf("writing %s ...\n",Spec[i].bin_file);
+
+      spec_apply(&Spec[i]);
 
-   printf("filtering entries ...\n");
-   book_filter();
+      printf("filtering entries ...\n");
+      size = book_filter((i == SpecNb-1) ? Book->entry : output,Spec[i].level);
 
-   printf("sorting entries ...\n");
-   book_sort();
+      printf("sorting entries ...\n");
+      book_sort((i == SpecNb-1) ? Book->entry : output,size);
 
-   printf("saving entries ...\n");
-   book_save(bin_file);
+      printf("saving entries ...\n");
+      book_save((i == SpecNb-1) ? Book->entry : output,size,Spec[i].bin_file);
+   }
+
+   if (output != NULL) huge_free(output);
 
    printf("all done!\n");
 }
 
+// spec_parse()
+
+static void spec_parse(spec_t * spec, char * argv[], int * i) {
+
+   ASSERT(spec!=NULL);
+   ASSERT(argv!=NULL);
+   ASSERT(i!=NULL&&argv[*i]!=NULL);
+
+   if (FALSE) {
+
+   } else if (my_string_equal(argv[*i],"-bin")) {
+
+      (*i)++;
+      if (argv[*i] == NULL) my_fatal("book_make(): missing argument\n");
+
+      my_string_set(&spec->bin_file,argv[*i]);
+
+   } else if (my_string_equal(argv[*i],"-max-ply")) {
+
+      (*i)++;
+      if (argv[*i] == NULL) my_fatal("book_make(): missing argument\n");
+
+      spec->max_ply = atoi(argv[*i]);
+      ASSERT(spec->max_ply>=0);
+
+   } else if (my_string_equal(argv[*i],"-min-game")) {
+
+      (*i)++;
+      if (argv[*i] == NULL) my_fatal("book_make(): missing argument\n");
+
+      spec->min_game = atoi(argv[*i]);
+      ASSERT(spec->min_game>0);
+
+   } else if (my_string_equal(argv[*i],"-min-score")) {
+
+      (*i)++;
+      if (argv[*i] == NULL) my_fatal("book_make(): missing argument\n");
+
+      spec->min_score = atof(argv[*i]) / 100.0;
+      ASSERT(spec->min_score>=0.0&&spec->min_score<=1.0);
+
+   } else if (my_string_equal(argv[*i],"-only-white")) {
+
+      spec->remove_white = FALSE;
+      spec->remove_black = TRUE;
+
+   } else if (my_string_equal(argv[*i],"-only-black")) {
+
+      spec->remove_white = TRUE;
+      spec->remove_black = FALSE;
+
+   } else if (my_string_equal(argv[*i],"-uniform")) {
+
+      spec->uniform = TRUE;
+
+   } else if (my_string_equal(argv[*i],"-packed")) {
+
+      spec->packed = TRUE;
+
+   } else {
+
+      my_fatal("book_make(): unknown option \"%s\"\n",argv[*i]);
+   }
+}
+
+// spec_apply()
+
+static void spec_apply(const spec_t * spec) {
+
+   ASSERT(spec!=NULL);
+
+   // keep_entry(), entry_score() and book_save() read the globals
+
+   MinGame = spec->min_game;
+   MinScore = spec->min_score;
+   RemoveWhite = spec->remove_white;
+   RemoveBlack = spec->remove_black;
+   Uniform = spec->uniform;
+   Packed = spec->packed;
+}
+
+// level_init()
+
+static void level_init() {
+
+   int i, j;
+
+   LevelNb = 0;
+
+   for (i = 0; i < SpecNb; i++) {
+
+      Spec[i].level = -1;
+      if (Spec[i].max_ply >= MaxPly) continue;
+
+      for (j = 0; j < LevelNb; j++) {
+         if (Level[j].max_ply == Spec[i].max_ply) break;
+      }
+
+      if (j == LevelNb) {
+         Level[j].max_ply = Spec[i].max_ply;
+         Level[j].n = (uint32 *) my_malloc(Book->alloc*sizeof(uint32));
+         Level[j].sum = (uint32 *) my_malloc(Book->alloc*sizeof(uint32));
+         LevelNb++;
+      }
+
+      Spec[i].level = j;
+   }
+}
+
+// book_make_memory()
+
+double book_make_memory(int entry_nb) {
+
+   ASSERT(entry_nb>=0);
+
+   // entry array and hash table, sized as resize() does
+
+#ifdef BOOK_BUCKETS
+   return ((double)entry_nb) * sizeof(entry_t) + ((double)hash_size(entry_nb)) * sizeof(bucket_t);
+#else
+   return ((double)entry_nb) * sizeof(entry_t) + ((double)hash_size(entry_nb)) * sizeof(sint32);
+#endif
+}
+
 // book_clear()
 
 static void book_clear() {
 
+#ifndef BOOK_BUCKETS
    int index;
+#endif
 
    Book->alloc = 1;
-   Book->mask = (Book->alloc * 2) - 1;
 
-   Book->entry = (entry_t *) my_malloc(Book->alloc*sizeof(entry_t));
+   Book->entry = (entry_t *) huge_malloc(Book->alloc*sizeof(entry_t));
    Book->size = 0;
 
-   Book->hash = (sint32 *) my_malloc((Book->alloc*2)*sizeof(sint32));
+#ifdef BOOK_BUCKETS
+   Book->mask = 0;
+
+   Book->bucket = (bucket_t *) huge_malloc(sizeof(bucket_t));
+   memset(Book->bucket,0,sizeof(bucket_t));
+
+   Book->old_mask = 0;
+   Book->old_bucket = NULL;
+   Book->migrate = 0;
+#else
+   Book->mask = (Book->alloc * 2) - 1;
+
+   Book->hash = (sint32 *) huge_malloc((Book->alloc*2)*sizeof(sint32));
    for (index = 0; index < Book->alloc*2; index++) {
       Book->hash[index] = NIL;
    }
+
+   Book->old_mask = 0;
+   Book->old_hash = NULL;
+   Book->migrate = 0;
+   Book->migrate_end = 0;
+#endif
+}
+
+// book_count()
+
+static void book_count(const pgn_pipe_files_t * files) {
+
+   pgn_pipe_stats_t stats[1];
+
+   ASSERT(files!=NULL);
+
+   cms_init(Sketch,SketchMemory);
+
+   pgn_pipe_run(files,MaxPly,ThreadNb,count_moves,NULL,stats);
+
+   printf("%.0fMB sketch.\n",cms_memory(Sketch)/1048576.0);
+}
+
+// count_moves()
+
+static void count_moves(const pgn_pipe_move_t move[], int move_nb, const pgn_pipe_pos_t * pos, void * arg) {
+
+   int i;
+
+   ASSERT(move!=NULL);
+   ASSERT(pos!=NULL);
+
+   (void) arg; // unused
+
+   for (i = 0; i < move_nb; i++) {
+      cms_add(Sketch,hash_pair_key(move[i].key,move[i].move));
+   }
+
+   print_games(pos);
 }
 
 // book_insert()
 
-static void book_insert(const char file_name[]) {
+static void book_insert(const pgn_pipe_files_t * files) {
 
-   pgn_t pgn[1];
-   board_t board[1];
-   int ply;
-   int result;
-   char string[256];
-   int move;
-   int pos;
+   pgn_pipe_stats_t stats[1];
 
-   ASSERT(file_name!=NULL);
+   ASSERT(files!=NULL);
 
-   pgn->game_nb=1;
+   // the table size is extrapolated from how fast it grows over the
+   // first few megabytes, instead of doubling all the way up
 
-   pgn_open(pgn,file_name);
+   FileSize = files->bytes;
+   SampleBytes = 0.0;
+   SampleEntries = 0;
+   GatedNb = 0;
+   GameNb = 0;
 
-   while (pgn_next_game(pgn)) {
+   pgn_pipe_run(files,MaxPly,ThreadNb,insert_moves,NULL,stats);
 
-      board_start(board);
-      ply = 0;
-      result = 0;
+   hash_migrate(Book->alloc); // all of it
 
-      if (FALSE) {
-      } else if (my_string_equal(pgn->result,"1-0")) {
-         result = +1;
-      } else if (my_string_equal(pgn->result,"0-1")) {
-         result = -1;
-      }
+   printf("%d game%s.\n",stats->game_nb+1,(stats->game_nb+1>2)?"s":"");
+   if (Sketch->counter != NULL) printf("%d rare moves skipped.\n",GatedNb);
+   printf("%d entries.\n",Book->size);
 
-      while (pgn_next_move(pgn,string,256)) {
+   if (ThreadNb > 1 || Verbose) pgn_pipe_print(stats);
 
-         if (ply < MaxPly) {
+   return;
+}
 
-            move = move_from_san(string,board);
+// insert_moves()
 
-            if (move == MoveNone || !move_is_legal(move,board)) {
-               my_fatal("book_insert(): illegal move \"%s\" at line %d, column %d,game %d\n",string,pgn->move_line,pgn->move_column,pgn->game_nb);
-            }
+static void insert_moves(const pgn_pipe_move_t move[], int move_nb, const pgn_pipe_pos_t * pos, void * arg) {
 
-            pos = find_entry(board,move);
+   ASSERT(move!=NULL);
+   ASSERT(pos!=NULL);
 
-            Book->entry[pos].n++;
-            Book->entry[pos].sum += result+1;
+   (void) arg; // unused
 
-            if (Book->entry[pos].n >= COUNT_MAX) {
-               halve_stats(board->key);
-            }
+   book_add(move,move_nb);
 
-            move_do(board,move);
-            ply++;
-            result = -result;
-         }
+   if (FileSize > 0.0) {
+
+      if (SampleBytes == 0.0 && pos->bytes >= SampleSize) {
+         SampleBytes = pos->bytes;
+         SampleEntries = Book->size;
+      } else if (SampleBytes != 0.0 && pos->bytes >= 4 * SampleBytes) {
+         book_reserve(estimate_size(FileSize,SampleEntries,SampleBytes,Book->size,pos->bytes));
+         FileSize = 0.0;
       }
-	  pgn->game_nb++;
-      if (pgn->game_nb % 10000 == 0) printf("%d games ...\n",pgn->game_nb);
    }
 
-   pgn_close(pgn);
+   print_games(pos);
+}
 
-   printf("%d game%s.\n",pgn->game_nb,(pgn->game_nb>2)?"s":"");
-   printf("%d entries.\n",Book->size);
+// print_games()
 
-   return;
+static void print_games(const pgn_pipe_pos_t * pos) {
+
+   ASSERT(pos!=NULL);
+
+   // progress every 10000 games, as counted by the old reader
+
+   if ((pos->game_nb+1) / 10000 > GameNb / 10000) printf("%d games ...\n",(pos->game_nb+1) / 10000 * 10000);
+
+   GameNb = pos->game_nb+1;
+
+   if (pos->file_end && pos->file_nb > 1) {
+      printf("%s: %d game%s.\n",pos->file_name,pos->file_game_nb,(pos->file_game_nb>1)?"s":"");
+   }
 }
 
 // book_filter()
 
-static void book_filter() {
+static int book_filter(entry_t output[], int level) {
 
+   entry_t entry[1];
    int src, dst;
 
-   // entry loop
+   ASSERT(output!=NULL);
+   ASSERT(level>=-1&&level<LevelNb);
+
+   // entry loop, output can be the table itself
 
    dst = 0;
 
    for (src = 0; src < Book->size; src++) {
-      if (keep_entry(src)) Book->entry[dst++] = Book->entry[src];
+
+      *entry = Book->entry[src];
+
+      if (level >= 0) {
+         entry->n = Level[level].n[src];
+         entry->sum = Level[level].sum[src];
+      }
+
+      if (keep_entry(entry)) output[dst++] = *entry;
    }
 
    ASSERT(dst>=0&&dst<=Book->size);
-   Book->size = dst;
 
-   printf("%d entries.\n",Book->size);
+   printf("%d entries.\n",dst);
+
+   return dst;
 }
 
 // book_sort()
 
-static void book_sort() {
+static void book_sort(entry_t entry[], int size) {
+
+   ASSERT(entry!=NULL);
+   ASSERT(size>=0);
 
    // sort keys for binary search
 
-   qsort(Book->entry,Book->size,sizeof(entry_t),&key_compare);
+   qsort(entry,size,sizeof(entry_t),&key_compare);
 }
 
 // book_save()
 
-static void book_save(const char file_name[]) {
+static void book_save(entry_t entry_list[], int entry_nb, const char file_name[]) {
 
    FILE * file;
+   book_pack_writer_t writer[1];
+   book_entry_t entry[1];
    int pos;
    char *header, *raw_header;
    unsigned int size;
-   int i;
+   unsigned int i;
+   int j;
+   uint32 max;
 
+   ASSERT(entry_list!=NULL);
+   ASSERT(entry_nb>=0);
    ASSERT(file_name!=NULL);
 
-   file = fopen(file_name,"wb");
-   if (file == NULL) my_fatal("book_save(): can't open file \"%s\" for writing: %s\n",file_name,strerror(errno));
+   // weights are scaled to 16 bits per position, once; the best move
+   // comes first after book_sort()
+
+   max = 0;
+
+   for (pos = 0; pos < entry_nb; pos++) {
+      if (pos == 0 || entry_list[pos].key != entry_list[pos-1].key) max = entry_score(&entry_list[pos]);
+      entry_list[pos].count = entry_weight(&entry_list[pos],max);
+   }
 
    pgheader_create(&header,"normal","Created by Polyglot.");
    pgheader_create_raw(&raw_header,header,&size);
    free(header);
 
+   if (Packed) {
+
+      // the header goes through the writer as null-key entries
+
+      book_pack_create(writer,file_name);
+
+      for (i = 0; i < size; i += 16) {
+         entry->key = U64(0x0);
+         for (j = 0; j < 8; j++) entry->key = (entry->key << 8) | (uint8) raw_header[i+j];
+         entry->move  = ((uint8) raw_header[i+8]  << 8) | (uint8) raw_header[i+9];
+         entry->count = ((uint8) raw_header[i+10] << 8) | (uint8) raw_header[i+11];
+         entry->n     = ((uint8) raw_header[i+12] << 8) | (uint8) raw_header[i+13];
+         entry->sum   = ((uint8) raw_header[i+14] << 8) | (uint8) raw_header[i+15];
+         book_pack_write(writer,entry);
+      }
+      free(raw_header);
+
+      for (pos = 0; pos < entry_nb; pos++) {
+         if (entry_list[pos].key == U64(0x0)) continue;
+         entry->key = entry_list[pos].key;
+         entry->move = entry_list[pos].move;
+         entry->count = entry_list[pos].count;
+         entry->n = 0;
+         entry->sum = 0;
+         book_pack_write(writer,entry);
+      }
+
+      book_pack_finish(writer);
+      return;
+   }
+
+   file = fopen(file_name,"wb");
+   if (file == NULL) my_fatal("book_save(): can't open file \"%s\" for writing: %s\n",file_name,strerror(errno));
+
    // write header
    
    for(i=0;i<size;i++){
@@ -355,14 +834,14 @@ static void book_save(const char file_name[]) {
    
    // entry loop
 
-   for (pos = 0; pos < Book->size; pos++) {
+   for (pos = 0; pos < entry_nb; pos++) {
 
-      ASSERT(keep_entry(pos));
+      ASSERT(keep_entry(&entry_list[pos]));
       /* null keys are reserved for the header */
-      if(Book->entry[pos].key!=U64(0x0)){
-	  write_integer(file,8,Book->entry[pos].key);
-	  write_integer(file,2,Book->entry[pos].move);
-	  write_integer(file,2,entry_score(&Book->entry[pos]));
+      if(entry_list[pos].key!=U64(0x0)){
+	  write_integer(file,8,entry_list[pos].key);
+	  write_integer(file,2,entry_list[pos].move);
+	  write_integer(file,2,entry_list[pos].count);
 	  write_integer(file,2,0);
 	  write_integer(file,2,0);
       }
@@ -371,147 +850,598 @@ static void book_save(const char file_name[]) {
    fclose(file);
 }
 
+// book_add()
+
+static void book_add(const pgn_pipe_move_t move[], int move_nb) {
+
+   int begin, end;
+   int i;
+   int pos;
+   int level;
+   int gate;
+
+   ASSERT(move!=NULL);
+   ASSERT(move_nb>=0);
+
+   // the sketch cannot tell counts above CmsCountMax apart, so a larger
+   // -min-game is left to book_filter()
+
+   gate = (MinGame < CmsCountMax) ? MinGame : CmsCountMax;
+
+   // every probe is a cache miss on a large table; the slots of a whole
+   // batch are requested first so that the misses overlap
+
+   for (begin = 0; begin < move_nb; begin = end) {
+
+      end = begin + BatchSize;
+      if (end > move_nb) end = move_nb;
+
+      for (i = begin; i < end; i++) hash_prefetch(move[i].key,move[i].move,0);
+      for (i = begin; i < end; i++) hash_prefetch(move[i].key,move[i].move,1);
+
+      for (i = begin; i < end; i++) {
+
+         if (Sketch->counter != NULL && cms_count(Sketch,hash_pair_key(move[i].key,move[i].move)) < gate) {
+
+            GatedNb++; // too rare, would not survive book_filter()
+
+         } else {
+
+            pos = find_entry(move[i].key,move[i].move,move[i].colour);
+
+            count_game(&Book->entry[pos].n,&Book->entry[pos].sum,move[i].result+1);
+
+            for (level = 0; level < LevelNb; level++) {
+               if (move[i].ply < Level[level].max_ply) {
+                  count_game(&Level[level].n[pos],&Level[level].sum[pos],move[i].result+1);
+               }
+            }
+         }
+      }
+   }
+}
+
 // find_entry()
 
-static int find_entry(const board_t * board, int move) {
+static int find_entry(uint64 key, int move, int colour) {
 
-   uint64 key;
-   int index;
    int pos;
+   int level;
 
-   ASSERT(board!=NULL);
    ASSERT(move==MoveNone || move_is_ok(move));
+   ASSERT(colour_is_ok(colour));
+
+   // search
+
+   pos = hash_find(key,move);
+   if (pos != NIL) return pos; // found
+
+   // not found
+
+   ASSERT(Book->size<=Book->alloc);
+
+   if (Book->size == Book->alloc) {
+
+      // allocate more memory
+
+      resize(Book->alloc*2);
+   }
+
+   // create a new entry
+
+   ASSERT(Book->size<Book->alloc);
+   pos = Book->size++;
+
+   Book->entry[pos].key = key;
+   Book->entry[pos].move = move;
+   Book->entry[pos].n = 0;
+   Book->entry[pos].sum = 0;
+   Book->entry[pos].colour = colour;
+
+   for (level = 0; level < LevelNb; level++) {
+      Level[level].n[pos] = 0;
+      Level[level].sum[pos] = 0;
+   }
+
+   // insert into the hash table
+
+   hash_insert(pos);
+
+   ASSERT(pos>=0&&pos<Book->size);
+
+   return pos;
+}
+
+// resize()
+
+static void resize(int alloc) {
+
+   double size;
+   int index;
+
+   ASSERT(alloc>Book->alloc);
+
+   // a growth before the last one is absorbed completes it first
+
+   hash_migrate(Book->alloc);
+
+   size = 0.0;
+   size += ((double)alloc) * sizeof(entry_t);
+#ifdef BOOK_BUCKETS
+   size += ((double)hash_size(alloc)) * sizeof(bucket_t);
+#else
+   size += ((double)hash_size(alloc)) * sizeof(sint32);
+#endif
+
+   if (size >= 1048576) if(!Quiet){
+           printf("allocating %gMB ...\n",size/1048576.0);
+       }
+
+   // resize arrays
+
+   Book->entry = (entry_t *) huge_realloc(Book->entry,alloc*sizeof(entry_t));
+
+   for (index = 0; index < LevelNb; index++) {
+      Level[index].n = (uint32 *) my_realloc(Level[index].n,alloc*sizeof(uint32));
+      Level[index].sum = (uint32 *) my_realloc(Level[index].sum,alloc*sizeof(uint32));
+   }
+
+   Book->alloc = alloc;
+
+#ifdef BOOK_BUCKETS
+
+   // the old buckets are kept until all of their entries are moved
+
+   Book->old_bucket = Book->bucket;
+   Book->old_mask = Book->mask;
+
+   Book->mask = hash_size(alloc) - 1;
+
+   Book->bucket = (bucket_t *) huge_malloc((Book->mask+1)*sizeof(bucket_t));
+   memset(Book->bucket,0,(Book->mask+1)*sizeof(bucket_t));
+
+   Book->migrate = 0;
+
+   hash_migrate(0);
+
+#else
+
+   // the old hash table is kept until all of its entries are moved
+
+   Book->old_hash = Book->hash;
+   Book->old_mask = Book->mask;
+
+   Book->mask = hash_size(alloc) - 1;
+
+   Book->hash = (sint32 *) huge_malloc((Book->mask+1)*sizeof(sint32));
+   for (index = 0; index <= (int)Book->mask; index++) {
+      Book->hash[index] = NIL;
+   }
+
+   Book->migrate = 0;
+   Book->migrate_end = Book->size;
+
+   hash_migrate(0);
+
+#endif
+}
+
+// book_reserve()
+
+static void book_reserve(int size) {
+
+   ASSERT(size>=0);
+
+   if (size > AllocMax) size = AllocMax;
+
+   if (size > Book->alloc) resize(size);
+}
+
+#ifdef BOOK_BUCKETS
+
+// hash_size()
+
+static int hash_size(int alloc) {
+
+   int size;
+
+   ASSERT(alloc>=0);
+
+   // buckets at most three-quarters full
+
+   for (size = 1; size * BucketSize < alloc + alloc/3; size *= 2)
+      ;
+
+   return size;
+}
+
+// hash_prefetch()
+
+static void hash_prefetch(uint64 key, int move, int stage) {
+
+   const bucket_t * bucket;
+   uint64 pair;
+   int match;
+   int slot;
+
+   pair = hash_pair_key(key,move);
+   bucket = &Book->bucket[pair&(uint64)Book->mask];
+
+   if (stage == 0) {
+      PREFETCH(bucket);
+      return;
+   }
+
+   // the entry is only fetched when the move is likely there
+
+   match = bucket_match(bucket,PAIR_TAG(pair));
+
+   if (match != 0) {
+      for (slot = 0; (match & (1<<slot)) == 0; slot++)
+         ;
+      PREFETCH(&Book->entry[bucket->pos[slot]]);
+   }
+}
+
+// hash_find()
+
+static int hash_find(uint64 key, int move) {
+
+   uint64 pair;
+   int pos;
+
+   // a grown table is filled a few buckets at a time
+
+   if (Book->old_bucket != NULL) hash_migrate(MigrateStep);
+
+   // buckets are chosen and tagged by (key, move), so the entries of a
+   // position spread over the table and a move that is not there is
+   // mostly settled in the bucket, without reading an entry
+
+   pair = hash_pair_key(key,move);
+
+   pos = bucket_find(Book->bucket,Book->mask,0,pair,key,move);
+
+   if (pos == NIL && Book->old_bucket != NULL) {
+      pos = bucket_find(Book->old_bucket,Book->old_mask,Book->migrate,pair,key,move);
+   }
+
+   return pos;
+}
+
+// hash_first()
+
+static int hash_first(uint64 key) {
+
+   int left, right, mid;
+
+   // only asked about books read by book_load(), which are sorted, the
+   // buckets cannot find a position without its move
+
+   left = 0;
+   right = Book->size;
+
+   while (left < right) {
+      mid = left + (right - left) / 2;
+      if (Book->entry[mid].key < key) {
+         left = mid+1;
+      } else {
+         right = mid;
+      }
+   }
+
+   if (left < Book->size && Book->entry[left].key == key) return left; // found
+
+   return NIL;
+}
+
+// hash_insert()
+
+static void hash_insert(int pos) {
+
+   ASSERT(pos>=0&&pos<Book->size);
+
+   bucket_insert(Book->bucket,Book->mask,hash_pair_key(Book->entry[pos].key,Book->entry[pos].move),pos);
+}
+
+// hash_migrate()
+
+static void hash_migrate(int step) {
+
+   const bucket_t * bucket;
+   int slot;
+
+   ASSERT(step>=0);
+
+   if (Book->old_bucket == NULL) return;
+
+   // old buckets below Book->migrate have their entries in the new table
+
+   for (; step > 0 && Book->migrate <= (int)Book->old_mask; step--) {
+
+      bucket = &Book->old_bucket[Book->migrate++];
+
+      for (slot = 0; slot < BucketSize && bucket->tag[slot] != 0; slot++) {
+         hash_insert(bucket->pos[slot]);
+      }
+   }
+
+   if (Book->migrate > (int)Book->old_mask) {
+      huge_free(Book->old_bucket);
+      Book->old_bucket = NULL;
+   }
+}
+
+// bucket_find()
+
+static int bucket_find(const bucket_t table[], uint32 mask, int skip, uint64 pair, uint64 key, int move) {
+
+   const bucket_t * bucket;
+   uint32 index;
+   int match;
+   int slot;
+   int pos;
+
+   ASSERT(table!=NULL);
+   ASSERT(skip>=0);
+
+   // buckets below skip are ignored, but still followed
+
+   for (index = pair & (uint64) mask; TRUE; index = (index+1) & mask) {
+
+      bucket = &table[index];
+
+      if ((int)index >= skip) {
+
+         match = bucket_match(bucket,PAIR_TAG(pair));
+
+         for (slot = 0; match != 0; slot++, match >>= 1) {
+
+            if ((match & 1) != 0) {
+
+               pos = bucket->pos[slot];
+               ASSERT(pos>=0&&pos<Book->size);
+
+               if (Book->entry[pos].key == key && Book->entry[pos].move == move) {
+                  return pos; // found
+               }
+            }
+         }
+      }
+
+      if (bucket->tag[BucketSize-1] == 0) return NIL; // the chain ends here
+   }
+}
+
+// bucket_insert()
+
+static void bucket_insert(bucket_t table[], uint32 mask, uint64 pair, int pos) {
+
+   bucket_t * bucket;
+   uint32 index;
+   int slot;
+
+   ASSERT(table!=NULL);
+   ASSERT(pos>=0&&pos<Book->size);
+
+   for (index = pair & (uint64) mask; table[index].tag[BucketSize-1] != 0; index = (index+1) & mask)
+      ;
+
+   bucket = &table[index];
+
+   for (slot = 0; bucket->tag[slot] != 0; slot++)
+      ;
+
+   ASSERT(slot<BucketSize);
+   bucket->tag[slot] = PAIR_TAG(pair);
+   bucket->pos[slot] = pos;
+}
+
+// bucket_match()
+
+static int bucket_match(const bucket_t * bucket, int tag) {
+
+   int match;
+#ifndef __SSE2__
+   int slot;
+#endif
+
+   ASSERT(bucket!=NULL);
+   ASSERT(tag>=0&&tag<256);
+
+   // the bits of the slots holding tag, unused slots hold 0
+
+#ifdef __SSE2__
+   match = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)bucket->tag),_mm_set1_epi8((char)tag)));
+#else
+   match = 0;
+   for (slot = 0; slot < BucketSize; slot++) {
+      if (bucket->tag[slot] == tag) match |= 1 << slot;
+   }
+#endif
+
+   return match & BucketFull;
+}
+
+#else
+
+// hash_size()
+
+static int hash_size(int alloc) {
+
+   int size;
+
+   ASSERT(alloc>=0);
+
+   // the entry array can have any size, the hash table stays a power of
+   // two at most two-thirds full
+
+   for (size = 2; size < alloc + alloc/2; size *= 2)
+      ;
+
+   return size;
+}
+
+// hash_prefetch()
+
+static void hash_prefetch(uint64 key, int move, int stage) {
+
+   int pos;
+
+   (void) move; // the table is indexed by key alone
+
+   if (stage == 0) {
+      PREFETCH(&Book->hash[key&(uint64)Book->mask]);
+   } else {
+      pos = Book->hash[key&(uint64)Book->mask];
+      if (pos != NIL) PREFETCH(&Book->entry[pos]);
+   }
+}
+
+// hash_find()
+
+static int hash_find(uint64 key, int move) {
+
+   int index;
+   int pos;
+
+   // a grown table is filled a few entries at a time
+
+   if (Book->old_hash != NULL) hash_migrate(MigrateStep);
+
+   for (index = key & (uint64) Book->mask; (pos=Book->hash[index]) != NIL; index = (index+1) & Book->mask) {
+
+      ASSERT(pos>=0&&pos<Book->size);
+
+      if (Book->entry[pos].key == key && Book->entry[pos].move == move) {
+         return pos; // found
+      }
+   }
+
+   if (Book->old_hash != NULL) {
+
+      for (pos = key & (uint64) Book->old_mask; Book->old_hash[pos] != NIL; pos = (pos+1) & Book->old_mask) {
+
+         // entries below Book->migrate were already found in the new table
+
+         if (Book->old_hash[pos] >= Book->migrate
+          && Book->entry[Book->old_hash[pos]].key == key
+          && Book->entry[Book->old_hash[pos]].move == move) {
+            return Book->old_hash[pos]; // found
+         }
+      }
+   }
 
-   ASSERT(move==MoveNone || move_is_legal(move,board));
+   return NIL;
+}
 
-   // init
+// hash_first()
 
-   key = board->key;
+static int hash_first(uint64 key) {
 
-   // search
+   int index;
+   int pos;
 
    for (index = key & (uint64) Book->mask; (pos=Book->hash[index]) != NIL; index = (index+1) & Book->mask) {
 
       ASSERT(pos>=0&&pos<Book->size);
 
-      if (Book->entry[pos].key == key && Book->entry[pos].move == move) {
-         return pos; // found
-      }
+      if (Book->entry[pos].key == key) return pos; // found
    }
 
-   // not found
-
-   ASSERT(Book->size<=Book->alloc);
-
-   if (Book->size == Book->alloc) {
+   return NIL;
+}
 
-      // allocate more memory
+// hash_insert()
 
-      resize();
+static void hash_insert(int pos) {
 
-      for (index = key & (uint64) Book->mask; Book->hash[index] != NIL; index = (index+1) & Book->mask)
-         ;
-   }
+   int index;
 
-   // create a new entry
+   ASSERT(pos>=0&&pos<Book->size);
 
-   ASSERT(Book->size<Book->alloc);
-   pos = Book->size++;
+   for (index = Book->entry[pos].key & (uint64) Book->mask; Book->hash[index] != NIL; index = (index+1) & Book->mask)
+      ;
 
-   Book->entry[pos].key = key;
-   Book->entry[pos].move = move;
-   Book->entry[pos].n = 0;
-   Book->entry[pos].sum = 0;
-   Book->entry[pos].colour = board->turn;
+   ASSERT(index>=0&&index<=(int)Book->mask);
+   Book->hash[index] = pos;
+}
 
-   // insert into the hash table
+// hash_migrate()
 
-   ASSERT(index>=0&&index<Book->alloc*2);
-   ASSERT(Book->hash[index]==NIL);
-   Book->hash[index] = pos;
+static void hash_migrate(int step) {
 
-   ASSERT(pos>=0&&pos<Book->size);
+   ASSERT(step>=0);
 
-   return pos;
-}
+   if (Book->old_hash == NULL) return;
 
-// rebuild_hash_table
+   for (; step > 0 && Book->migrate < Book->migrate_end; step--) {
+      hash_insert(Book->migrate++);
+   }
 
-static void rebuild_hash_table(){
-    int index,pos;
-    for (index = 0; index < Book->alloc*2; index++) {
-        Book->hash[index] = NIL;
-    }
-    for (pos = 0; pos < Book->size; pos++) {
-        for (index = Book->entry[pos].key & (uint64) Book->mask; Book->hash[index] != NIL; index = (index+1) & Book->mask)
-         ;
-        ASSERT(index>=0&&index<Book->alloc*2);
-        Book->hash[index] = pos;
-    }
+   if (Book->migrate == Book->migrate_end) {
+      huge_free(Book->old_hash);
+      Book->old_hash = NULL;
+   }
 }
 
-static void resize() {
+#endif
 
-   int size;
+// estimate_size()
 
-   ASSERT(Book->size==Book->alloc);
+static int estimate_size(double bytes, int size_1, double bytes_1, int size_2, double bytes_2) {
 
-   Book->alloc *= 2;
-   Book->mask = (Book->alloc * 2) - 1;
+   double growth;
+   double size;
 
-   size = 0;
-   size += Book->alloc * sizeof(entry_t);
-   size += (Book->alloc*2) * sizeof(sint32);
+   ASSERT(bytes_2>bytes_1);
 
-   if (size >= 1048576) if(!Quiet){
-           printf("allocating %gMB ...\n",((double)size)/1048576.0);
-       }
+   // new positions get rarer as the input goes on, the table grows like
+   // a power of the input size (Heaps' law)
 
-   // resize arrays
+   if (size_1 <= 0 || size_2 <= size_1) return size_2;
 
-   Book->entry = (entry_t *) my_realloc(Book->entry,Book->alloc*sizeof(entry_t));
-   Book->hash = (sint32 *) my_realloc(Book->hash,(Book->alloc*2)*sizeof(sint32));
+   growth = log(((double)size_2)/size_1) / log(bytes_2/bytes_1);
+   if (growth > 1.0) growth = 1.0;
 
-   // rebuild hash table
+   size = size_2 * pow(bytes/bytes_2,growth) * 1.1;
 
-   rebuild_hash_table();
+   return (size > AllocMax) ? AllocMax : (int) size;
 }
 
+// print_memory()
 
-// halve_stats()
-
-static void halve_stats(uint64 key) {
-
-   int index;
-   int pos;
+static void print_memory() {
 
-   // search
+   huge_stats_t stats[1];
 
-   for (index = key & (uint64) Book->mask; (pos=Book->hash[index]) != NIL; index = (index+1) & Book->mask) {
+   huge_stats(stats);
 
-      ASSERT(pos>=0&&pos<Book->size);
+   printf("table memory: %d kB",stats->hugetlb_kb+stats->madvise_kb+stats->small_kb);
 
-      if (Book->entry[pos].key == key) {
-         Book->entry[pos].n = (Book->entry[pos].n + 1) / 2;
-         Book->entry[pos].sum = (Book->entry[pos].sum + 1) / 2;
-      }
+   if (stats->page_size == 0) {
+      printf(", no huge pages");
+   } else {
+      printf(", %d kB huge pages",stats->page_size);
+      if (stats->hugetlb_kb != 0) printf(", %d kB hugetlbfs",stats->hugetlb_kb);
+      if (stats->madvise_kb != 0) printf(", %d kB advised",stats->madvise_kb);
+      if (stats->backed_kb >= 0) printf(" (%d kB backed)",stats->backed_kb);
    }
+
+   printf(", %d pages to map.\n",stats->tlb_nb);
 }
 
 // keep_entry()
 
-static bool keep_entry(int pos) {
+static bool keep_entry(const entry_t * entry) {
 
-   const entry_t * entry;
    int colour;
    double score;
 
-   ASSERT(pos>=0&&pos<Book->size);
-
-   entry = &Book->entry[pos];
+   ASSERT(entry!=NULL);
 
    // if (entry->n == 0) return FALSE;
-   if (entry->n < MinGame) return FALSE;
+   if (entry->n < (uint32) MinGame) return FALSE;
 
    if (entry->sum == 0) return FALSE;
 
@@ -532,11 +1462,27 @@ static bool keep_entry(int pos) {
    return TRUE;
 }
 
+// count_game()
+
+static void count_game(uint32 * n, uint32 * sum, int points) {
+
+   ASSERT(n!=NULL);
+   ASSERT(sum!=NULL);
+   ASSERT(points>=0&&points<=2);
+
+   // a move seen more than 2^32 times keeps the score it had then
+
+   if (*n == CountMax || *sum > CountMax - 2) return;
+
+   (*n)++;
+   *sum += points;
+}
+
 // entry_score()
 
-static int entry_score(const entry_t * entry) {
+static uint32 entry_score(const entry_t * entry) {
 
-   int score;
+   uint32 score;
 
    ASSERT(entry!=NULL);
 
@@ -545,11 +1491,31 @@ static int entry_score(const entry_t * entry) {
 
    if (Uniform) score = 1;
 
-   ASSERT(score>=0);
-
    return score;
 }
 
+// entry_weight()
+
+static int entry_weight(const entry_t * entry, uint32 max) {
+
+   uint32 score;
+   int weight;
+
+   ASSERT(entry!=NULL);
+
+   score = entry_score(entry);
+   ASSERT(score<=max);
+
+   if (max <= 0xFFFF) return score;
+
+   // proportional, but a kept move never drops to zero
+
+   weight = (int) (((double)score) * 0xFFFF / max + 0.5);
+   if (weight == 0 && score != 0) weight = 1;
+
+   return weight;
+}
+
 // key_compare()
 
 static int key_compare(const void * p1, const void * p2) {
@@ -566,8 +1532,12 @@ static int key_compare(const void * p1, const void * p2) {
       return +1;
    } else if (entry_1->key < entry_2->key) {
       return -1;
+   } else if (entry_score(entry_1) < entry_score(entry_2)) {
+      return +1; // highest score first
+   } else if (entry_score(entry_1) > entry_score(entry_2)) {
+      return -1;
    } else {
-      return entry_score(entry_2) - entry_score(entry_1); // highest score first
+      return 0;
    }
 }
 
@@ -666,12 +1636,14 @@ static void book_load(const char filename[]){
     fseek(f,0L,SEEK_END);   // superportable way to get size of book!
     size=ftell(f)/16;
     fseek(f,0,SEEK_SET);
+        // the size is known, allocate once
+    book_reserve(size);
     for(i=0L;i<size;i++){
         read_entry_file(f,entry);
         ASSERT(Book->size<=Book->alloc);
         if (Book->size == Book->alloc) {
                 // allocate more memoryx
-            resize();
+            resize(Book->alloc*2);
         }
             // insert into the book
         pos = Book->size++;
@@ -682,35 +1654,37 @@ static void book_load(const char filename[]){
         Book->entry[pos].n = entry->n;
         Book->entry[pos].sum = entry->sum;
         Book->entry[pos].colour = ColourNone;
-            // find free hash table spot
-        for (index = entry->key & (uint64) Book->mask;
-             Book->hash[index] != NIL;
-             index = (index+1) & Book->mask);
             // insert into the hash table
-        ASSERT(index>=0&&index<Book->alloc*2);
-        ASSERT(Book->hash[index]==NIL);
-        Book->hash[index] = pos;
+        hash_insert(pos);
         ASSERT(pos>=0&&pos<Book->size);
     }
     fclose(f);
+        // distinct keys only, absent positions are rejected in one probe
+    if(BookKeys->key!=NULL) key_set_free(BookKeys);
+    key_set_init(BookKeys,size);
+    for(pos=0;pos<Book->size;pos++){
+        key_set_insert(BookKeys,Book->entry[pos].key);
+    }
+        // and mostly from a cache-resident filter
+    bloom_free(BookFilter);
+    bloom_init(BookFilter,BookKeys->size+1,BloomBitsPerKey);
+    for(index=0;index<=(int)BookKeys->mask;index++){
+        if(BookKeys->key[index]!=U64(0x0)){
+            bloom_add(BookFilter,BookKeys->key[index]);
+        }
+    }
+    if(BookKeys->zero) bloom_add(BookFilter,U64(0x0));
 }
 
 // gen_book_moves()
 // similar signature as gen_legal_moves
 static int gen_book_moves(list_t * list, const board_t * board){
-    int first_pos, pos, index;
+    int first_pos, pos;
     entry_t entry[1];
-    bool found;
     list_clear(list);
-    found=FALSE;
-    for (index = board->key & (uint64) Book->mask; (first_pos=Book->hash[index]) != NIL; index = (index+1) & Book->mask) {
-        ASSERT(first_pos>=0&&first_pos<Book->size);
-        if (Book->entry[first_pos].key == board->key) {
-            found=TRUE;
-            break; // found
-        }
-    }
-    if(!found) return -1;
+    if(!key_set_find(BookKeys,board->key)) return -1;
+    first_pos=hash_first(board->key);
+    if(first_pos==NIL) return -1;
     if(Book->entry[first_pos].move==MoveNone) return -1;
     for (pos = first_pos; pos < Book->size; pos++) {
         *entry=Book->entry[pos];
@@ -729,67 +1703,84 @@ static int gen_book_moves(list_t * list, const board_t * board){
 // similar signature as gen_legal_moves
 static void gen_opp_book_moves(list_t * list, const board_t * board){
     int move;
-    list_t new_list[1], legal_moves[1];
+    list_t new_list[1], moves[1];
     board_t new_board[1];
     int i;
+    uint64 key;
     list_clear(list);
-    gen_legal_moves(legal_moves,board);
-    for (i = 0; i < list_size(legal_moves); i++) {
-        move = list_move(legal_moves,i);
+    gen_moves(moves,board);
+    for (i = 0; i < list_size(moves); i++) {
+        move = list_move(moves,i);
+            // most replies leave the book, tell from the key alone
+        key=hash_move_key(board,move);
+        if(!bloom_test(BookFilter,key) || !key_set_find(BookKeys,key)){
+            continue;
+        }
             // scratch_board
         memcpy(new_board, board, sizeof(board_t));
         move_do(new_board,move);
-        gen_book_moves(new_list,new_board); // wasteful in time but tested!
+        if(is_in_check(new_board,colour_opp(new_board->turn))){
+            continue; // illegal
+        }
+        gen_book_moves(new_list,new_board);
         if(list_size(new_list)!=0){
             list_add(list,move);
         }
     }
 }
 
+// push_move()
+// appends the text of a move to the prefix of the current line,
+// which is popped by decrementing info->height
+
+static void push_move(info_t *info, const edge_t *edge){
+    char *string;
+    int colour;
+    int ply;
+    int size;
+    ply=info->height;
+    ASSERT(ply>=0&&ply<1024);
+    string=info->prefix+info->prefix_size[ply];
+    size=0;
+    if(ply%2==0){
+        size+=sprintf(string,"%d. ",ply/2+1);
+        colour=White;
+    }else{
+        colour=Black;
+    }
+    size+=sprintf(string+size,"%s",edge->san);
+    if(colour==info->initial_color){
+        size+=sprintf(string+size,"{%.0f%%} ",100*edge->prob);
+    }else{
+        string[size++]=' ';
+    }
+    info->prefix_size[ply+1]=info->prefix_size[ply]+size;
+    info->height++;
+}
+
 static void print_moves(info_t *info){
-    board_t board[1];
-    char move_string[256];
-    int i;
-    int color=White;
     if(!info->output){
         return;
     }
-    board_start(board);
-    for(i=0;i<info->height;i++){
-        if(color==White){
-            fprintf(info->output,"%d. ",i/2+1);
-            color=Black;
-        }else{
-            color=White;
-        }
-        move_to_san(info->moves[i],board,move_string,256);
-        fprintf(info->output,"%s", move_string);
-        if(color==colour_opp(info->initial_color)){
-            fprintf(info->output,"{%.0f%%} ",100*info->probs[i]);
-        }else{
-            fprintf(info->output," ");
-        }
-        move_do(board,info->moves[i]);
-    }
+    fwrite(info->prefix,1,info->prefix_size[info->height],info->output);
 }
 
-static int search_book(board_t *board, info_t *info, search_t search){
+// search_book()
+// numbers the lines of the graph walk_book() expanded, in the order
+// of a depth-first search ending lines at cycles and transpositions
+
+static int search_book(int id, const board_t *board, info_t *info, search_t search){
+    node_t *node;
+    edge_t *edge;
+    edge_t swap;
     list_t list[1];
     board_t new_board[1];
-    uint16 move;
     int count;
     int ret;
-    int i;
-    int offset;
-    int pos;
-    int size;
-    int prob_sum;
-    double probs[256];
-    for(i=0;i<256;i++){
-        probs[i]=0.0;  // kill compiler warnings
-    }
+    int i, j;
+    node=&Node[id];
     for(i=0;i<info->height;i++){
-        if(board->key==info->keys[i]){
+        if(node->key==info->keys[i]){
             if(info->output){
                 fprintf(info->output,"%d: ",info->line);
                 print_moves(info);
@@ -799,58 +1790,46 @@ static int search_book(board_t *board, info_t *info, search_t search){
             return 1; // end of line because of cycle
         }
     }
-    if(!info->book_trans_only || (info->book_trans_only && search==BOOK)){
-        info->keys[info->height]=board->key;
-        size=Book->size;  // hack
-        pos=find_entry(board,MoveNone);
-        if(size==Book->size){
-            if(info->output){
-                fprintf(info->output,"%d: ",info->line);
-                print_moves(info);
-                fprintf(info->output,"{trans: line=%d, ply=%d}\n",
-                        Book->entry[pos].line,
-                        Book->entry[pos].height);
-            }
-            info->line++;
-            return 1; // end of line because of transposition
-        }else{
-            Book->entry[pos].height=info->height;
-            Book->entry[pos].line=info->line;
+    info->keys[info->height]=node->key;
+    if(node->line!=NIL){
+        if(info->output){
+            fprintf(info->output,"%d: ",info->line);
+            print_moves(info);
+            fprintf(info->output,"{trans: line=%d, ply=%d}\n",
+                    node->line,
+                    node->height);
         }
+        info->line++;
+        return 1; // end of line because of transposition
     }
-    count=0;
-    if(search==BOOK){
-        offset=gen_book_moves(list,board);
-        if(info->extended_search){
+    node->height=info->height;
+    node->line=info->line;
+        // generated moves come in the order of the piece lists, which
+        // depend on the path a walker took, lines follow this one's
+    if(node->edge_nb>1 && (search!=BOOK || Extended)){
+        if(search==BOOK){
             gen_legal_moves(list,board);
+        }else{
+            gen_moves(list,board);
         }
-//        ASSERT(offset!=-1);
-        if(offset!=-1){ // only FALSE in starting position for black book
-            Book->entry[offset].colour=board->turn;
-            prob_sum=0;
-            if(!info->extended_search){
-                for(i=0;i<list_size(list);i++){
-                    prob_sum+=((uint16)list_value(list,i));
-                }
-                for(i=0;i<list_size(list);i++){
-                    probs[i]=((double)((uint16)list_value(list,i)))/((double)prob_sum);
-                }
+        for(i=0,j=0;i<list_size(list) && j<node->edge_nb;i++){
+            for(edge=&node->edge[j];edge<&node->edge[node->edge_nb];edge++){
+                if(edge->move==list_move(list,i)) break;
             }
+            if(edge==&node->edge[node->edge_nb]) continue;
+            swap=*edge;
+            *edge=node->edge[j];
+            node->edge[j++]=swap;
         }
-    }else{
-        gen_opp_book_moves(list,board);
     }
-    for (i = 0; i < list_size(list); i++) {
-        move = list_move(list,i);
-        memcpy(new_board, board, sizeof(board_t));
-        ASSERT(move_is_legal(move,new_board));
-        move_do(new_board,move);
+    count=0;
+    for (i = 0; i < node->edge_nb; i++) {
+        edge=&node->edge[i];
         ASSERT(search!=opp_search(search));
-        info->moves[info->height++]=move;
-        if(search==BOOK){
-            info->probs[info->height-1]=probs[i];
-        }
-        ret=search_book(new_board, info, opp_search(search));
+        push_move(info,edge);
+        memcpy(new_board,board,sizeof(board_t));
+        move_do(new_board,edge->move);
+        ret=search_book(edge->child, new_board, info, opp_search(search));
         if(ret==0 && search==BOOK){
             if(info->output){
                 fprintf(info->output,"%d: ",info->line);
@@ -870,23 +1849,9 @@ static int search_book(board_t *board, info_t *info, search_t search){
 void init_info(info_t *info){
     info->line=1;
     info->height=0;
+    info->prefix_size[0]=0;
     info->output=NULL;
     info->initial_color=White;
-    info->book_trans_only=FALSE;
-}
-
-// book_clean()
-// remove MoveNone entries from book and rebuild hash table
-void book_clean(){
-    int read_ptr,write_ptr;
-    write_ptr=0;
-    for(read_ptr=0;read_ptr<Book->size;read_ptr++){
-        if(Book->entry[read_ptr].move!=MoveNone){
-            Book->entry[write_ptr++]=Book->entry[read_ptr];
-        }
-    }
-    Book->size=write_ptr;
-    rebuild_hash_table();
 }
 
 // book_dump()
@@ -896,8 +1861,10 @@ void book_dump(int argc, char * argv[]) {
     const char * txt_file=NULL;
     char string[StringSize];
     int color=ColourNone;
-    board_t board[1];
+    int thread_nb=my_cpu_nb();
+    tree_t tree[1];
     info_t info[1];
+    board_t board[1];
     int i;
     FILE *f;
     my_string_set(&bin_file,"book.bin");
@@ -923,6 +1890,11 @@ void book_dump(int argc, char * argv[]) {
             }else{
                 my_fatal("book_dump(): unknown color \"%s\"\n",argv[i]);
             }
+        } else if (my_string_equal(argv[i],"-threads")) {
+            i++;
+            if (i==argc) my_fatal("book_dump(): missing argument\n");
+            thread_nb=atoi(argv[i]);
+            if(thread_nb<1) my_fatal("book_dump(): bad thread number \"%s\"\n",argv[i]);
         } else {
             my_fatal("book_dump(): unknown option \"%s\"\n",argv[i]);
         }
@@ -938,37 +1910,453 @@ void book_dump(int argc, char * argv[]) {
     book_clear();
     if(!Quiet){printf("loading book ...\n");}
     book_load(bin_file);
-    board_start(board);
     init_info(info);
     info->initial_color=color;
     if(!(f=fopen(txt_file,"w"))){
         my_fatal("book_dump(): can't open file \"%s\" for writing: %s",
                  txt_file,strerror(errno));
     }
+    setvbuf(f,NULL,_IOFBF,OutputBufferSize);
     info->output=f;
     fprintf(info->output,"Dump of \"%s\" for %s.\n",
             bin_file,color==White?"white":"black");
     if(color==White){
         if(!Quiet){printf("generating lines for white...\n");}
-        search_book(board,info, BOOK);
     }else{
         if(!Quiet){printf("generating lines for black...\n");}
-        search_book(board,info, ALL);
     }
+    walk_book(tree,color,FALSE,TRUE,thread_nb);
+    board_start(board);
+    search_book(0,board,info,(color==White)?BOOK:ALL);
+    walk_free();
+    fclose(f);
+}
+
+// walk_book()
+// expands every position reachable through the book once, on
+// thread_nb threads stealing each other's pending positions.
+// With graph the positions and their moves are kept in Node[]
+// (the root is node 0) so search_book() can number the lines
+// sequentially, only reordering the moves it was given
+
+static void walk_book(tree_t *tree, int colour, bool extended, bool graph, int thread_nb){
+    task_t *task;
+    int alloc;
+    int i;
+    ASSERT(!(graph && extended));
+    ASSERT(thread_nb>=1);
+    Extended=extended;
+        // a reply is a book move, and every book position is visited once
+    alloc=2*Book->size+2;
+    NodeNb=0;
+    NodeAlloc=0;
+    Node=NULL;
+    if(graph){
+        NodeAlloc=alloc;
+        Node=(node_t *) my_malloc(NodeAlloc*sizeof(node_t));
+    }
+    for(i=0;i<ShardNb;i++){
+        my_mutex_init(Shard[i].mutex);
+        Shard[i].mask=1;
+        while(Shard[i].mask<(uint32)(4*alloc/ShardNb)) Shard[i].mask<<=1;
+        Shard[i].key=(uint64 *) my_malloc(Shard[i].mask*sizeof(uint64));
+        Shard[i].node=(sint32 *) my_malloc(Shard[i].mask*sizeof(sint32));
+        memset(Shard[i].node,-1,Shard[i].mask*sizeof(sint32));
+        Shard[i].mask--;
+        Shard[i].size=0;
+    }
+    WalkerNb=thread_nb;
+    Walker=(walker_t *) my_malloc(WalkerNb*sizeof(walker_t));
+    for(i=0;i<WalkerNb;i++){
+        my_mutex_init(Walker[i].mutex);
+        Walker[i].head=0;
+        Walker[i].size=0;
+        Walker[i].alloc=256;
+        Walker[i].task=(task_t *) my_malloc(Walker[i].alloc*sizeof(task_t));
+        Walker[i].tree->visit_nb=0;
+        Walker[i].tree->node_nb=0;
+        Walker[i].tree->leaf_nb=0;
+        Walker[i].tree->book_nb=0;
+    }
+    task=&Walker[0].task[Walker[0].size++];
+    board_start(task->board);
+    task->search=(colour==White)?BOOK:ALL;
+    task->root=TRUE;
+    walk_insert(task->board->key,&task->node);
+    Walker[0].tree->visit_nb++;
+    TaskNb=1;
+    for(i=1;i<WalkerNb;i++){
+        my_thread_create(&Walker[i].thread,walker_loop,&Walker[i]);
+    }
+    walker_loop(&Walker[0]);
+    for(i=1;i<WalkerNb;i++){
+        my_thread_join(&Walker[i].thread);
+    }
+    tree->visit_nb=0;
+    tree->node_nb=0;
+    tree->leaf_nb=0;
+    tree->book_nb=0;
+    for(i=0;i<WalkerNb;i++){
+        tree->visit_nb+=Walker[i].tree->visit_nb;
+        tree->node_nb+=Walker[i].tree->node_nb;
+        tree->leaf_nb+=Walker[i].tree->leaf_nb;
+        tree->book_nb+=Walker[i].tree->book_nb;
+        my_free(Walker[i].task);
+        my_mutex_free(Walker[i].mutex);
+    }
+    my_free(Walker);
+    Walker=NULL;
+    for(i=0;i<ShardNb;i++){
+        my_free(Shard[i].key);
+        my_free(Shard[i].node);
+        my_mutex_free(Shard[i].mutex);
+    }
+}
+
+// walk_free()
+
+static void walk_free(){
+    int i;
+    if(Node==NULL) return;
+    for(i=0;i<NodeNb;i++){
+        if(Node[i].edge!=NULL) my_free(Node[i].edge);
+    }
+    my_free(Node);
+    Node=NULL;
+}
+
+// walk_insert()
+// returns FALSE if the position was already there
+
+static bool walk_insert(uint64 key, int *id){
+    shard_t *shard;
+    uint64 *old_key;
+    sint32 *old_node;
+    uint32 old_mask;
+    uint32 index;
+    uint32 i;
+    shard=&Shard[key>>ShardShift];
+    my_mutex_lock(shard->mutex);
+    for(index=key&shard->mask;shard->node[index]!=NIL;index=(index+1)&shard->mask){
+        if(shard->key[index]==key){
+            *id=shard->node[index];
+            my_mutex_unlock(shard->mutex);
+            return FALSE;
+        }
+    }
+    *id=my_atomic_add(&NodeNb,1)-1;
+    if(Node!=NULL){
+        if(*id>=NodeAlloc) my_fatal("walk_insert(): too many positions\n");
+        Node[*id].key=key;
+        Node[*id].edge=NULL;
+        Node[*id].edge_nb=0;
+        Node[*id].line=NIL;
+        Node[*id].height=0;
+    }
+    shard->key[index]=key;
+    shard->node[index]=*id;
+    shard->size++;
+    if(2*(uint32)shard->size>shard->mask){
+        old_key=shard->key;
+        old_node=shard->node;
+        old_mask=shard->mask;
+        shard->mask=2*old_mask+1;
+        shard->key=(uint64 *) my_malloc((shard->mask+1)*sizeof(uint64));
+        shard->node=(sint32 *) my_malloc((shard->mask+1)*sizeof(sint32));
+        memset(shard->node,-1,(shard->mask+1)*sizeof(sint32));
+        for(index=0;index<=old_mask;index++){
+            if(old_node[index]!=NIL){
+                for(i=old_key[index]&shard->mask;shard->node[i]!=NIL;i=(i+1)&shard->mask);
+                shard->key[i]=old_key[index];
+                shard->node[i]=old_node[index];
+            }
+        }
+        my_free(old_key);
+        my_free(old_node);
+    }
+    my_mutex_unlock(shard->mutex);
+    return TRUE;
+}
+
+// walker_loop()
+// runs tasks from the top of our stack, or steals the oldest
+// (largest) ones from the bottom of another walker's
+
+static void walker_loop(void *arg){
+    walker_t *walker;
+    walker_t *victim;
+    task_t task[StealNb];
+    int task_nb;
+    int n;
+    int i;
+    walker=(walker_t *) arg;
+    n=0;
+    while(TRUE){
+        task_nb=0;
+        my_mutex_lock(walker->mutex);
+        if(walker->size>walker->head){
+            memcpy(&task[0],&walker->task[--walker->size],sizeof(task_t));
+            task_nb=1;
+        }
+        if(walker->size==walker->head){
+            walker->head=0;
+            walker->size=0;
+        }
+        my_mutex_unlock(walker->mutex);
+        for(i=1;task_nb==0 && i<WalkerNb;i++){
+            victim=&Walker[(walker-Walker+i)%WalkerNb];
+            my_mutex_lock(victim->mutex);
+            while(task_nb<StealNb && 2*task_nb<victim->size-victim->head){
+                memcpy(&task[task_nb++],&victim->task[victim->head++],sizeof(task_t));
+            }
+            if(task_nb==0 && victim->size>victim->head){
+                memcpy(&task[task_nb++],&victim->task[victim->head++],sizeof(task_t));
+            }
+            my_mutex_unlock(victim->mutex);
+        }
+        if(task_nb==0){
+            if(TaskNb==0) break;
+            my_sleep((n++<16)?0:1);
+            continue;
+        }
+        n=0;
+        if(task_nb>1){
+            walker_push(walker,&task[1],task_nb-1);
+        }
+        walk_expand(walker,task);
+        my_atomic_add(&TaskNb,-1);
+    }
+}
+
+// walker_push()
+
+static void walker_push(walker_t *walker, const task_t *task, int task_nb){
+    my_mutex_lock(walker->mutex);
+    walker_reserve(walker,task_nb);
+    memcpy(&walker->task[walker->size],task,task_nb*sizeof(task_t));
+    walker->size+=task_nb;
+    my_mutex_unlock(walker->mutex);
+}
+
+// walker_reserve()
+// to be called with the walker locked
+
+static void walker_reserve(walker_t *walker, int task_nb){
+    if(walker->size+task_nb<=walker->alloc) return;
+    if(walker->head>0){
+        memmove(walker->task,&walker->task[walker->head],
+                (walker->size-walker->head)*sizeof(task_t));
+        walker->size-=walker->head;
+        walker->head=0;
+    }
+    while(walker->size+task_nb>walker->alloc){
+        walker->alloc*=2;
+        walker->task=(task_t *) my_realloc(walker->task,walker->alloc*sizeof(task_t));
+    }
+}
+
+// walk_expand()
+// generates the moves of a position and queues the new positions
+
+static void walk_expand(walker_t *walker, const task_t *task){
+    list_t list[1];
+    int child[256];
+    bool fresh[256];
+    edge_t *edge;
+    task_t *new_task;
+    search_t search;
+    uint64 key;
+    int prob_sum;
+    int fresh_nb;
+    int move;
+    int i;
+    walker->tree->node_nb++;
+    if(task->search==BOOK){
+        if(gen_book_moves(list,task->board)!=-1){
+            walker->tree->book_nb++;
+        }
+        if(Extended){
+            gen_legal_moves(list,task->board);
+        }
+    }else{
+        gen_opp_book_moves(list,task->board);
+        if(list_size(list)==0 && !task->root){
+            walker->tree->leaf_nb++; // a book move with no reply, the end of a line
+        }
+    }
+    search=opp_search(task->search);
+    fresh_nb=0;
+    for(i=0;i<list_size(list);i++){
+        move=list_move(list,i);
+        key=hash_move_key(task->board,move);
+        walker->tree->visit_nb++;
+            // line counts need every position once, reachability only ours
+        if(search==BOOK || !Extended){
+            fresh[i]=walk_insert(key,&child[i]);
+        }else{
+            child[i]=NIL;
+            fresh[i]=TRUE;
+        }
+        if(fresh[i]) fresh_nb++;
+    }
+    if(Node!=NULL && list_size(list)>0){
+        edge=(edge_t *) my_malloc(list_size(list)*sizeof(edge_t));
+        prob_sum=0;
+        if(task->search==BOOK){
+            for(i=0;i<list_size(list);i++){
+                prob_sum+=((uint16)list_value(list,i));
+            }
+        }
+        for(i=0;i<list_size(list);i++){
+            move=list_move(list,i);
+            edge[i].move=move;
+            edge[i].child=child[i];
+            edge[i].prob=(prob_sum==0)?0.0:
+                ((double)((uint16)list_value(list,i)))/((double)prob_sum);
+            move_to_san(move,task->board,edge[i].san,sizeof(edge[i].san));
+        }
+        Node[task->node].edge=edge;
+        Node[task->node].edge_nb=list_size(list);
+    }
+    if(fresh_nb==0) return;
+    my_atomic_add(&TaskNb,fresh_nb);
+    my_mutex_lock(walker->mutex);
+    walker_reserve(walker,fresh_nb);
+        // last move on top, searched first like the recursion would
+    for(i=list_size(list)-1;i>=0;i--){
+        if(!fresh[i]) continue;
+        new_task=&walker->task[walker->size++];
+        memcpy(new_task->board,task->board,sizeof(board_t));
+        move_do(new_task->board,list_move(list,i));
+        new_task->node=child[i];
+        new_task->search=search;
+        new_task->root=FALSE;
+    }
+    my_mutex_unlock(walker->mutex);
+}
+
+// key_set_init()
+
+static void key_set_init(key_set_t * set, int size){
+    ASSERT(set!=NULL);
+    set->mask=1;
+    while(set->mask<2*(uint32)size) set->mask<<=1;
+    set->key=(uint64 *) my_malloc(set->mask*sizeof(uint64));
+    memset(set->key,0,set->mask*sizeof(uint64));
+    set->mask--;
+    set->size=0;
+    set->zero=FALSE;
+}
+
+// key_set_free()
+
+static void key_set_free(key_set_t * set){
+    ASSERT(set!=NULL);
+    my_free(set->key);
+    set->key=NULL;
+}
+
+// key_set_insert()
+// returns FALSE if the key was already there
+
+static bool key_set_insert(key_set_t * set, uint64 key){
+    uint64 * old_key;
+    uint32 old_mask;
+    uint32 index;
+    ASSERT(set!=NULL);
+    if(key==U64(0x0)){ // 0 marks free slots
+        if(set->zero) return FALSE;
+        set->zero=TRUE;
+        return TRUE;
+    }
+    for(index=key&set->mask;set->key[index]!=U64(0x0);index=(index+1)&set->mask){
+        if(set->key[index]==key) return FALSE;
+    }
+    set->key[index]=key;
+    set->size++;
+    if(2*(uint32)set->size>set->mask){
+            // keep the load factor under 1/2
+        old_key=set->key;
+        old_mask=set->mask;
+        set->mask=2*old_mask+1;
+        set->key=(uint64 *) my_malloc((set->mask+1)*sizeof(uint64));
+        memset(set->key,0,(set->mask+1)*sizeof(uint64));
+        for(index=0;index<=old_mask;index++){
+            if(old_key[index]!=U64(0x0)){
+                uint32 i;
+                for(i=old_key[index]&set->mask;set->key[i]!=U64(0x0);i=(i+1)&set->mask);
+                set->key[i]=old_key[index];
+            }
+        }
+        my_free(old_key);
+    }
+    return TRUE;
+}
+
+// key_set_find()
+
+static bool key_set_find(const key_set_t * set, uint64 key){
+    uint32 index;
+    ASSERT(set!=NULL);
+    if(key==U64(0x0)) return set->zero;
+    for(index=key&set->mask;set->key[index]!=U64(0x0);index=(index+1)&set->mask){
+        if(set->key[index]==key) return TRUE;
+    }
+    return FALSE;
+}
+
+// filter_info()
+// memory and false positive rate of the probe filter book_open() would build
+
+static void filter_info(){
+    bloom_t filter[1];
+    uint64 last_key;
+    uint64 key;
+    int key_nb;
+    int pos;
+    int hit;
+    int i;
+    key_nb=0;
+    last_key=0;
+    for(pos=0;pos<Book->size;pos++){
+        if(Book->entry[pos].key!=last_key){
+            last_key=Book->entry[pos].key;
+            key_nb++;
+        }
+    }
+    bloom_clear(filter);
+    bloom_init(filter,key_nb,BloomBitsPerKey);
+    last_key=0;
+    for(pos=0;pos<Book->size;pos++){
+        if(Book->entry[pos].key!=last_key){
+            last_key=Book->entry[pos].key;
+            bloom_add(filter,last_key);
+        }
+    }
+        // random keys are out of book (up to a 2^-64 chance)
+    hit=0;
+    key=U64(0x0123456789ABCDEF);
+    for(i=0;i<FilterProbeNb;i++){
+        key=key*U64(6364136223846793005)+U64(1442695040888963407);
+        if(bloom_test(filter,key^(key>>29))) hit++;
+    }
+    printf("Filter memory (bytes)          : %8.0f\n",bloom_memory(filter));
+    printf("Filter false positives (est.)  : %7.3f%%\n",100.0*bloom_fpr(filter));
+    printf("Filter false positives (meas.) : %7.3f%%\n",(100.0*hit)/FilterProbeNb);
+    bloom_free(filter);
 }
 
 // book_info()
 
 void book_info(int argc,char* argv[]){
     const char *bin_file=NULL;
-    board_t board[1];
-    info_t info[1];
+    tree_t tree[1];
     uint64 last_key;
     int pos;
     int white_pos,black_pos,total_pos,white_pos_extended,
         black_pos_extended,white_pos_extended_diff,black_pos_extended_diff;
-    int s;
     bool extended_search=FALSE;
+    int thread_nb=my_cpu_nb();
     int i;
     Quiet=TRUE;
     my_string_set(&bin_file,"book.bin");
@@ -983,6 +2371,11 @@ void book_info(int argc,char* argv[]){
             my_string_set(&bin_file,argv[i]);
         } else if (my_string_equal(argv[i],"-exact")) {
             extended_search=TRUE;
+        } else if (my_string_equal(argv[i],"-threads")) {
+            i++;
+            if (i==argc) my_fatal("book_info(): missing argument\n");
+            thread_nb=atoi(argv[i]);
+            if(thread_nb<1) my_fatal("book_info(): bad thread number \"%s\"\n",argv[i]);
         } else {
             my_fatal("book_info(): unknown option \"%s\"\n",argv[i]);
         }
@@ -990,82 +2383,36 @@ void book_info(int argc,char* argv[]){
     book_clear();
     if(!Quiet){printf("loading book ...\n");}
     book_load(bin_file);
-    s=Book->size;
-
-    board_start(board);
-    init_info(info);
-    info->book_trans_only=FALSE;
-    info->initial_color=White;
-    info->extended_search=FALSE;
-    search_book(board,info, BOOK);
-    printf("Lines for white                : %8d\n",info->line-1);
 
+    walk_book(tree,White,FALSE,FALSE,thread_nb);
+    printf("Lines for white                : %8d\n",
+           tree->visit_nb-tree->node_nb+tree->leaf_nb);
+    white_pos=tree->book_nb;
 
-    info->line=1;
-    info->height=0;
-    info->initial_color=Black;
-    book_clean();
-    ASSERT(Book->size==s);
-    board_start(board);
-    search_book(board,info, ALL);
-    printf("Lines for black                : %8d\n",info->line-1);
+    walk_book(tree,Black,FALSE,FALSE,thread_nb);
+    printf("Lines for black                : %8d\n",
+           tree->visit_nb-tree->node_nb+tree->leaf_nb);
+    black_pos=tree->book_nb;
 
-    book_clean();
-    ASSERT(Book->size==s);
-    white_pos=0;
-    black_pos=0;
     total_pos=0;
     last_key=0;
     for(pos=0;pos<Book->size;pos++){
         if(Book->entry[pos].key==last_key){
-            ASSERT(Book->entry[pos].colour==ColourNone);
             continue;
         }
         last_key=Book->entry[pos].key;
         total_pos++;
-        if(Book->entry[pos].colour==White){
-            white_pos++;
-        }else if(Book->entry[pos].colour==Black){
-            black_pos++;
-        }
     }
     printf("Positions on lines for white   : %8d\n",white_pos);
     printf("Positions on lines for black   : %8d\n",black_pos);
 
     
     if(extended_search){
-        init_info(info);
-        info->book_trans_only=TRUE;
-        info->initial_color=White;
-        info->extended_search=TRUE;
-        book_clean();
-        board_start(board);
-        search_book(board,info, BOOK);
-
-        init_info(info);
-        info->book_trans_only=TRUE;
-        info->initial_color=Black;
-        info->extended_search=TRUE;
-        book_clean();
-        board_start(board);
-        search_book(board,info, ALL);
-        book_clean();
-        ASSERT(Book->size==s);
-        white_pos_extended=0;
-        black_pos_extended=0;
-        last_key=0;
-        for(pos=0;pos<Book->size;pos++){
-            if(Book->entry[pos].key==last_key){
-                ASSERT(Book->entry[pos].colour==ColourNone);
-                continue;
-            }
-            last_key=Book->entry[pos].key;
-            if(Book->entry[pos].colour==White){
-                white_pos_extended++;
-            }else if(Book->entry[pos].colour==Black){
-                black_pos_extended++;
-            }
-        }
+            // all our moves, not only book ones
+        walk_book(tree,White,TRUE,FALSE,thread_nb);
+        white_pos_extended=tree->book_nb;
+        walk_book(tree,Black,TRUE,FALSE,thread_nb);
+        black_pos_extended=tree->book_nb;
         white_pos_extended_diff=white_pos_extended-white_pos;
         black_pos_extended_diff=black_pos_extended-black_pos;
         printf("Unreachable white positions(?) : %8d\n",
@@ -1081,4 +2428,5 @@ void book_info(int argc,char* argv[]){
         printf("Isolated positions             : %8d\n",
                total_pos-white_pos-black_pos);
     }
+    filter_info();
 }
\ No newline at end of file
@@ -14,6 +14,8 @@ extern void book_make (int argc, char * argv[]);
 extern void book_dump (int argc, char * argv[]);
 extern void book_info (int argc, char * argv[]);
 
+extern double book_make_memory (int entry_nb);
+
 #endif // !defined BOOK_MAKE_H
 
 // end of book_make.h
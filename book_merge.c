@@ -9,6 +9,7 @@
 #include <string.h>
 
 #include "book_merge.h"
+#include "book_pack.h"
 #include "util.h"
 #include "pgheader.h"
 
@@ -37,6 +38,9 @@ static book_t In1[1];
 static book_t In2[1];
 static book_t Out[1];
 
+static bool Packed;
+static book_pack_writer_t Writer[1];
+
 static const char *default_header="@PG@\n1.0\n1\nnormal\n";
 
 // prototypes
@@ -50,6 +54,7 @@ static bool   read_entry    (book_t * book, entry_t * entry, int n);
 static void   write_entry   (book_t * book, const entry_t * entry);
 
 static uint64 read_integer  (FILE * file, int size);
+static uint64 read_memory   (const uint8 * address, int size);
 static void   write_integer (FILE * file, int size, uint64 n);
 
 // functions
@@ -130,6 +135,8 @@ void book_merge(int argc, char * argv[]) {
    out_file = NULL;
    my_string_set(&out_file,"out.bin");
 
+   Packed = FALSE;
+
    for (i = 1; i < argc; i++) {
 
       if (FALSE) {
@@ -159,6 +166,10 @@ void book_merge(int argc, char * argv[]) {
 
          my_string_set(&out_file,argv[i]);
 
+      } else if (my_string_equal(argv[i],"-packed")) {
+
+         Packed = TRUE;
+
       } else {
 
          my_fatal("book_merge(): unknown option \"%s\"\n",argv[i]);
@@ -212,12 +223,31 @@ void book_merge(int argc, char * argv[]) {
 
    book_open(In1,in_file_1,"rb");
    book_open(In2,in_file_2,"rb");
-   book_open(Out,out_file,"wb");
 
    // write header
-   
-   for(i=0;i<size;i++){
-       fputc(raw_header[i],Out->file);
+
+   if (Packed) {
+
+      // the packed writer takes the header as null-key entries
+
+      book_pack_create(Writer,out_file);
+
+      for (i = 0; i < size; i += 16) {
+         e1->key   = read_memory((uint8 *) raw_header+i,8);
+         e1->move  = read_memory((uint8 *) raw_header+i+8,2);
+         e1->count = read_memory((uint8 *) raw_header+i+10,2);
+         e1->n     = read_memory((uint8 *) raw_header+i+12,2);
+         e1->sum   = read_memory((uint8 *) raw_header+i+14,2);
+         write_entry(Out,e1);
+      }
+
+   } else {
+
+      book_open(Out,out_file,"wb");
+
+      for(i=0;i<size;i++){
+          fputc(raw_header[i],Out->file);
+      }
    }
    free(raw_header);
 
@@ -275,7 +305,12 @@ void book_merge(int argc, char * argv[]) {
 
    book_close(In1);
    book_close(In2);
-   book_close(Out);
+
+   if (Packed) {
+      book_pack_finish(Writer);
+   } else {
+      book_close(Out);
+   }
 
    if (skip != 0) {
       printf("skipped %d entr%s.\n",skip,(skip>1)?"ies":"y");
@@ -305,6 +340,10 @@ static void book_open(book_t * book, const char file_name[], const char mode[])
    book->file = fopen(file_name,mode);
    if (book->file == NULL) my_fatal("book_open(): can't open file \"%s\": %s\n",file_name,strerror(errno));
 
+   if (mode[0] == 'r' && book_pack_detect(book->file)) {
+      my_fatal("book_open(): \"%s\" is packed, run unpack-book first\n",file_name);
+   }
+
    if (fseek(book->file,0,SEEK_END) == -1) {
       my_fatal("book_open(): fseek(): %s\n",strerror(errno));
    }
@@ -351,9 +390,21 @@ static bool read_entry(book_t * book, entry_t * entry, int n) {
 
 static void write_entry(book_t * book, const entry_t * entry) {
 
+   book_entry_t packed[1];
+
    ASSERT(book!=NULL);
    ASSERT(entry!=NULL);
 
+   if (Packed) {
+      packed->key   = entry->key;
+      packed->move  = entry->move;
+      packed->count = entry->count;
+      packed->n     = entry->n;
+      packed->sum   = entry->sum;
+      book_pack_write(Writer,packed);
+      return;
+   }
+
    write_integer(book->file,8,entry->key);
    write_integer(book->file,2,entry->move);
    write_integer(book->file,2,entry->count);
@@ -395,6 +446,23 @@ static uint64 read_integer(FILE * file, int size) {
    return n;
 }
 
+// read_memory()
+
+static uint64 read_memory(const uint8 * address, int size) {
+
+   uint64 n;
+   int i;
+
+   ASSERT(address!=NULL);
+   ASSERT(size>0&&size<=8);
+
+   n = 0;
+
+   for (i = 0; i < size; i++) n = (n << 8) | address[i];
+
+   return n;
+}
+
 // write_integer()
 
 static void write_integer(FILE * file, int size, uint64 n) {
@@ -0,0 +1,553 @@
+
+// book_mph.c
+
+// includes
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "book_index.h"
+#include "book_mph.h"
+#include "hash.h"
+#include "util.h"
+
+// constants
+
+#define BucketSize 3
+
+static const char MphMagic[] = "PGMPH002";
+
+static const uint32 PilotMax = 0xFFFFFFFF;
+
+// prototypes
+
+static uint64 mph_hash      (uint64 key, uint64 seed);
+static uint32 mph_slot      (uint64 hash, uint32 pilot, int size);
+static uint32 mph_print     (uint64 key);
+
+static bool   mph_try       (book_mph_t * mph, const uint64 key[], const sint32 pos[]);
+
+static uint64 file_key      (const void * file, int pos);
+
+static bool   read_integer  (FILE * file, int size, uint64 * n);
+static void   write_integer (FILE * file, int size, uint64 n);
+
+// functions
+
+// book_mph_clear()
+
+void book_mph_clear(book_mph_t * mph) {
+
+   ASSERT(mph!=NULL);
+
+   mph->size = 0;
+   mph->book_size = 0;
+   mph->bucket_nb = 0;
+   mph->seed = 0;
+   mph->pilot = NULL;
+   mph->slot = NULL;
+}
+
+// book_mph_free()
+
+void book_mph_free(book_mph_t * mph) {
+
+   ASSERT(mph!=NULL);
+
+   if (mph->pilot != NULL) my_free(mph->pilot);
+   if (mph->slot != NULL) my_free(mph->slot);
+
+   book_mph_clear(mph);
+}
+
+// book_mph_build()
+
+void book_mph_build(book_mph_t * mph, const uint64 key[], const sint32 pos[], int size, int book_size) {
+
+   ASSERT(mph!=NULL);
+   ASSERT(key!=NULL);
+   ASSERT(pos!=NULL);
+   ASSERT(size>=0);
+
+   // hash and displace: every bucket searches a pilot that sends all
+   // its keys to free slots, biggest buckets first
+
+   book_mph_free(mph);
+
+   mph->size = size;
+   mph->book_size = book_size;
+   mph->bucket_nb = size / BucketSize + 1;
+   mph->seed = U64(0x9E3779B97F4A7C15);
+
+   mph->pilot = (uint32 *) my_malloc(mph->bucket_nb*sizeof(uint32));
+   mph->slot = (uint32 *) my_malloc((size*2+2)*sizeof(uint32));
+
+   while (!mph_try(mph,key,pos)) {
+      mph->seed = hash_mix_64(mph->seed+1);
+   }
+}
+
+// book_mph_find()
+
+int book_mph_find(const book_mph_t * mph, uint64 key) {
+
+   uint64 hash;
+   uint32 slot;
+
+   ASSERT(mph!=NULL);
+
+   if (mph->size == 0) return -1;
+
+   hash = mph_hash(key,mph->seed);
+   slot = mph_slot(hash,mph->pilot[REDUCE(hash,mph->bucket_nb)],mph->size);
+
+   if (mph->slot[slot*2] != mph_print(key)) return -1;
+
+   return mph->slot[slot*2+1];
+}
+
+// book_mph_load()
+
+bool book_mph_load(book_mph_t * mph, const char file_name[], int book_size, uint64 digest) {
+
+   FILE * file;
+   char magic[8];
+   uint64 n;
+   int i;
+
+   ASSERT(mph!=NULL);
+   ASSERT(file_name!=NULL);
+
+   // a table built for another version of the book is stale, see
+   // book_digest()
+
+   file = fopen(file_name,"rb");
+   if (file == NULL) return FALSE;
+
+   book_mph_free(mph);
+
+   if (fread(magic,1,8,file) != 8 || memcmp(magic,MphMagic,8) != 0) goto error;
+
+   if (!read_integer(file,8,&n) || n != (uint64) book_size) goto error;
+   mph->book_size = book_size;
+
+   if (!read_integer(file,8,&n) || n != digest) goto error;
+
+   if (!read_integer(file,8,&n) || n > (uint64) book_size) goto error;
+   mph->size = (int) n;
+
+   if (!read_integer(file,8,&n) || n != (uint64) (mph->size / BucketSize + 1)) goto error;
+   mph->bucket_nb = (int) n;
+
+   if (!read_integer(file,8,&mph->seed)) goto error;
+
+   mph->pilot = (uint32 *) my_malloc(mph->bucket_nb*sizeof(uint32));
+   mph->slot = (uint32 *) my_malloc((mph->size*2+2)*sizeof(uint32));
+
+   for (i = 0; i < mph->bucket_nb; i++) {
+      if (!read_integer(file,4,&n)) goto error;
+      mph->pilot[i] = (uint32) n;
+   }
+
+   for (i = 0; i < mph->size*2; i++) {
+      if (!read_integer(file,4,&n)) goto error;
+      mph->slot[i] = (uint32) n;
+   }
+
+   fclose(file);
+
+   return TRUE;
+
+error:
+
+   fclose(file);
+   book_mph_free(mph);
+
+   return FALSE;
+}
+
+// book_mph_save()
+
+void book_mph_save(const book_mph_t * mph, const char file_name[], uint64 digest) {
+
+   FILE * file;
+   int i;
+
+   ASSERT(mph!=NULL);
+   ASSERT(file_name!=NULL);
+
+   file = fopen(file_name,"wb");
+   if (file == NULL) my_fatal("book_mph_save(): can't open file \"%s\" for writing: %s\n",file_name,strerror(errno));
+
+   fwrite(MphMagic,1,8,file);
+   write_integer(file,8,mph->book_size);
+   write_integer(file,8,digest);
+   write_integer(file,8,mph->size);
+   write_integer(file,8,mph->bucket_nb);
+   write_integer(file,8,mph->seed);
+
+   for (i = 0; i < mph->bucket_nb; i++) {
+      write_integer(file,4,mph->pilot[i]);
+   }
+
+   for (i = 0; i < mph->size*2; i++) {
+      write_integer(file,4,mph->slot[i]);
+   }
+
+   if (fclose(file) == EOF) {
+      my_fatal("book_mph_save(): fclose(): %s\n",strerror(errno));
+   }
+}
+
+// book_build_index()
+
+void book_build_index(int argc, char * argv[]) {
+
+   const char * bin_file;
+   const char * mph_file;
+   char string[StringSize];
+   book_mph_t mph[1];
+   FILE * file;
+   uint64 * key;
+   sint32 * first;
+   uint64 last_key, n;
+   uint64 digest;
+   int book_size;
+   int size;
+   int pos;
+   int i;
+   double start;
+
+   bin_file = NULL;
+   my_string_set(&bin_file,"book.bin");
+
+   mph_file = NULL;
+
+   for (i = 1; i < argc; i++) {
+
+      if (FALSE) {
+
+      } else if (my_string_equal(argv[i],"build-index")) {
+
+         // skip
+
+      } else if (my_string_equal(argv[i],"-bin")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_build_index(): missing argument\n");
+
+         my_string_set(&bin_file,argv[i]);
+
+      } else if (my_string_equal(argv[i],"-out")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_build_index(): missing argument\n");
+
+         my_string_set(&mph_file,argv[i]);
+
+      } else {
+
+         my_fatal("book_build_index(): unknown option \"%s\"\n",argv[i]);
+      }
+   }
+
+   if (mph_file == NULL) {
+      snprintf(string,StringSize,"%s.mph",bin_file);
+      string[StringSize-1] = '\0';
+      my_string_set(&mph_file,string);
+   }
+
+   start = now_real();
+
+   file = fopen(bin_file,"rb");
+   if (file == NULL) my_fatal("book_build_index(): can't open file \"%s\": %s\n",bin_file,strerror(errno));
+
+   if (fseek(file,0,SEEK_END) == -1) {
+      my_fatal("book_build_index(): fseek(): %s\n",strerror(errno));
+   }
+
+   book_size = ftell(file) / 16;
+
+   digest = book_digest(file_key,file,book_size);
+
+   fseek(file,0,SEEK_SET);
+
+   // distinct keys and the position of their first entry
+
+   printf("reading keys ...\n");
+
+   key = (uint64 *) my_malloc((book_size+1)*sizeof(uint64));
+   first = (sint32 *) my_malloc((book_size+1)*sizeof(sint32));
+
+   size = 0;
+   last_key = U64(0x0);
+
+   for (pos = 0; pos < book_size; pos++) {
+
+      if (!read_integer(file,8,&key[size]) || !read_integer(file,8,&n)) {
+         my_fatal("book_build_index(): %s: unexpected end of file\n",bin_file);
+      }
+
+      // null keys are reserved for the header
+
+      if (key[size] == U64(0x0) || key[size] == last_key) continue;
+
+      if (key[size] < last_key) {
+         my_fatal("book_build_index(): %s is not sorted at entry %d\n",bin_file,pos);
+      }
+
+      last_key = key[size];
+      first[size++] = pos;
+   }
+
+   fclose(file);
+
+   printf("%d keys.\n",size);
+
+   printf("building index ...\n");
+
+   book_mph_clear(mph);
+   book_mph_build(mph,key,first,size,book_size);
+
+   my_free(key);
+   my_free(first);
+
+   printf("saving index ...\n");
+
+   book_mph_save(mph,mph_file,digest);
+
+   printf("%d buckets, %.1f bits/key, %.2fs.\n",
+          mph->bucket_nb,
+          (size==0) ? 0.0 : (32.0*(mph->bucket_nb+2.0*size))/size,
+          now_real()-start);
+
+   book_mph_free(mph);
+
+   printf("all done!\n");
+}
+
+// mph_try()
+
+static bool mph_try(book_mph_t * mph, const uint64 key[], const sint32 pos[]) {
+
+   int * bucket_start;
+   int * bucket_key;
+   int * order;
+   int * size_start;
+   uint64 * hash;
+   uint8 * taken;
+   uint32 slot[64];
+   int size_max;
+   int b, i, j, k;
+   int first, n;
+   uint32 pilot;
+   bool ok;
+
+   ASSERT(mph!=NULL);
+
+   // group the keys by bucket (counting sort)
+
+   hash = (uint64 *) my_malloc((mph->size+1)*sizeof(uint64));
+   bucket_start = (int *) my_malloc((mph->bucket_nb+1)*sizeof(int));
+   bucket_key = (int *) my_malloc((mph->size+1)*sizeof(int));
+
+   for (b = 0; b <= mph->bucket_nb; b++) bucket_start[b] = 0;
+
+   for (i = 0; i < mph->size; i++) {
+      hash[i] = mph_hash(key[i],mph->seed);
+      bucket_start[REDUCE(hash[i],mph->bucket_nb)+1]++;
+   }
+
+   size_max = 0;
+
+   for (b = 0; b < mph->bucket_nb; b++) {
+      if (bucket_start[b+1] > size_max) size_max = bucket_start[b+1];
+      bucket_start[b+1] += bucket_start[b];
+   }
+
+   // a bucket this large means a poor seed
+
+   if (size_max > 64) {
+      my_free(hash);
+      my_free(bucket_start);
+      my_free(bucket_key);
+      return FALSE;
+   }
+
+   order = (int *) my_malloc((mph->bucket_nb+1)*sizeof(int));
+   size_start = (int *) my_malloc((size_max+2)*sizeof(int));
+
+   for (i = 0; i < mph->bucket_nb; i++) order[i] = bucket_start[i];
+
+   for (i = 0; i < mph->size; i++) {
+      bucket_key[order[REDUCE(hash[i],mph->bucket_nb)]++] = i;
+   }
+
+   // order the buckets by decreasing size (counting sort)
+
+   for (n = 0; n <= size_max+1; n++) size_start[n] = 0;
+
+   for (b = 0; b < mph->bucket_nb; b++) {
+      size_start[size_max-(bucket_start[b+1]-bucket_start[b])+1]++;
+   }
+
+   for (n = 0; n <= size_max; n++) size_start[n+1] += size_start[n];
+
+   for (b = 0; b < mph->bucket_nb; b++) {
+      order[size_start[size_max-(bucket_start[b+1]-bucket_start[b])]++] = b;
+   }
+
+   // search a pilot for every bucket
+
+   taken = (uint8 *) my_malloc(mph->size+1);
+   memset(taken,0,mph->size+1);
+
+   ok = TRUE;
+
+   for (i = 0; i < mph->bucket_nb && ok; i++) {
+
+      b = order[i];
+      first = bucket_start[b];
+      n = bucket_start[b+1] - first;
+
+      if (n == 0) {
+         mph->pilot[b] = 0;
+         continue;
+      }
+
+      for (pilot = 0; ; pilot++) {
+
+         for (j = 0; j < n; j++) {
+
+            slot[j] = mph_slot(hash[bucket_key[first+j]],pilot,mph->size);
+            if (taken[slot[j]]) break;
+
+            for (k = 0; k < j; k++) {
+               if (slot[k] == slot[j]) break;
+            }
+
+            if (k < j) break;
+         }
+
+         if (j == n) break; // found
+
+         if (pilot == PilotMax) {
+            ok = FALSE;
+            break;
+         }
+      }
+
+      if (!ok) break;
+
+      mph->pilot[b] = pilot;
+
+      for (j = 0; j < n; j++) {
+         k = bucket_key[first+j];
+         taken[slot[j]] = TRUE;
+         mph->slot[slot[j]*2] = mph_print(key[k]);
+         mph->slot[slot[j]*2+1] = pos[k];
+      }
+   }
+
+   my_free(hash);
+   my_free(bucket_start);
+   my_free(bucket_key);
+   my_free(order);
+   my_free(size_start);
+   my_free(taken);
+
+   return ok;
+}
+
+// mph_hash()
+
+static uint64 mph_hash(uint64 key, uint64 seed) {
+
+   return hash_mix_64(key ^ seed);
+}
+
+// mph_slot()
+
+static uint32 mph_slot(uint64 hash, uint32 pilot, int size) {
+
+   ASSERT(size>0);
+
+   return REDUCE(hash_mix_64(hash^(pilot*U64(0x9E3779B97F4A7C15))),size);
+}
+
+// mph_print()
+
+static uint32 mph_print(uint64 key) {
+
+   // the low half of the key, the slot only depends on its hash
+
+   return (uint32) key;
+}
+
+// file_key()
+
+static uint64 file_key(const void * file, int pos) {
+
+   uint64 key;
+
+   ASSERT(file!=NULL);
+   ASSERT(pos>=0);
+
+   if (fseek((FILE *) file,((long)pos)*16,SEEK_SET) == -1 || !read_integer((FILE *) file,8,&key)) {
+      my_fatal("file_key(): can't read entry %d\n",pos);
+      return U64(0x0);
+   }
+
+   return key;
+}
+
+// read_integer()
+
+static bool read_integer(FILE * file, int size, uint64 * n) {
+
+   int i;
+   int b;
+
+   ASSERT(file!=NULL);
+   ASSERT(size>0&&size<=8);
+   ASSERT(n!=NULL);
+
+   *n = 0;
+
+   for (i = 0; i < size; i++) {
+
+      b = fgetc(file);
+      if (b == EOF) return FALSE;
+
+      ASSERT(b>=0&&b<256);
+      *n = (*n << 8) | b;
+   }
+
+   return TRUE;
+}
+
+// write_integer()
+
+static void write_integer(FILE * file, int size, uint64 n) {
+
+   int i;
+   int b;
+
+   ASSERT(file!=NULL);
+   ASSERT(size>0&&size<=8);
+   ASSERT(size==8||n>>(size*8)==0);
+
+   for (i = size-1; i >= 0; i--) {
+
+      b = (n >> (i*8)) & 0xFF;
+      ASSERT(b>=0&&b<256);
+
+      if (fputc(b,file) == EOF) {
+         my_fatal("write_integer(): fputc(): %s\n",strerror(errno));
+      }
+   }
+}
+
+// end of book_mph.c
@@ -0,0 +1,37 @@
+
+// book_mph.h
+
+#ifndef BOOK_MPH_H
+#define BOOK_MPH_H
+
+// includes
+
+#include "util.h"
+
+// types
+
+typedef struct {
+   int size;
+   int book_size;
+   int bucket_nb;
+   uint64 seed;
+   uint32 * pilot;
+   uint32 * slot;
+} book_mph_t;
+
+// functions
+
+extern void book_mph_clear   (book_mph_t * mph);
+extern void book_mph_free    (book_mph_t * mph);
+
+extern void book_mph_build   (book_mph_t * mph, const uint64 key[], const sint32 pos[], int size, int book_size);
+extern int  book_mph_find    (const book_mph_t * mph, uint64 key);
+
+extern bool book_mph_load    (book_mph_t * mph, const char file_name[], int book_size, uint64 digest);
+extern void book_mph_save    (const book_mph_t * mph, const char file_name[], uint64 digest);
+
+extern void book_build_index (int argc, char * argv[]);
+
+#endif // !defined BOOK_MPH_H
+
+// end of book_mph.h
@@ -0,0 +1,683 @@
+
+// book_pack.c
+
+// includes
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "book_pack.h"
+#include "util.h"
+
+// constants
+
+static const char PackMagic[] = "PGPACK01";
+
+#define ReadBufferSize (1<<20)
+
+// entry tag, 24 bits little-endian: the move, the byte length of the
+// key delta (0 for the same position), and the field sizes
+
+#define TagMoveMask   0xFFFF
+#define TagDeltaShift 16
+#define TagLearn      (1 << 20)
+#define TagWide       (1 << 21)
+
+// prototypes
+
+static void   block_flush   (book_pack_writer_t * writer);
+
+static uint64 block_key     (const book_pack_t * pack, int block);
+static uint64 block_offset  (const book_pack_t * pack, int block);
+static uint64 block_end     (const book_pack_t * pack, int block);
+
+static uint64 read_memory   (const uint8 * address, int size);
+static bool   read_entry    (FILE * file, book_entry_t * entry);
+static void   write_integer (FILE * file, int size, uint64 n);
+static void   write_entry   (FILE * file, const book_entry_t * entry);
+
+// functions
+
+// book_pack_detect()
+
+bool book_pack_detect(FILE * file) {
+
+   char magic[8];
+   bool packed;
+
+   ASSERT(file!=NULL);
+
+   if (fseek(file,0,SEEK_SET) == -1) return FALSE;
+
+   packed = fread(magic,1,8,file) == 8 && memcmp(magic,PackMagic,8) == 0;
+
+   fseek(file,0,SEEK_SET);
+
+   return packed;
+}
+
+// book_pack_clear()
+
+void book_pack_clear(book_pack_t * pack) {
+
+   ASSERT(pack!=NULL);
+
+   pack->data = NULL;
+   pack->size = 0;
+   pack->block_nb = 0;
+   pack->index = NULL;
+}
+
+// book_pack_open()
+
+bool book_pack_open(book_pack_t * pack, const uint8 data[], size_t size) {
+
+   uint64 entry_nb, block_nb, block_size, index;
+   uint64 offset, last_offset, key, last_key;
+   uint64 b;
+
+   ASSERT(pack!=NULL);
+   ASSERT(data!=NULL);
+
+   book_pack_clear(pack);
+
+   if (size < PackHeaderSize || memcmp(data,PackMagic,8) != 0) return FALSE;
+
+   entry_nb = read_memory(data+8,8);
+   block_size = read_memory(data+16,4);
+   block_nb = read_memory(data+20,4);
+   index = read_memory(data+24,8);
+
+   // only our block size, and an index that fits
+
+   if (block_size != PackBlockSize) return FALSE;
+   if (block_nb != (entry_nb + PackBlockSize - 1) / PackBlockSize) return FALSE;
+   if (entry_nb > 0x7FFFFFFF) return FALSE;
+   if (index < PackHeaderSize || index > size || (size - index) / 16 < block_nb) return FALSE;
+
+   // blocks in key order and in file order, between the header and the
+   // index, so that book_pack_block() can bound every read
+
+   last_offset = PackHeaderSize;
+   last_key = U64(0x0);
+
+   for (b = 0; b < block_nb; b++) {
+
+      key = read_memory(data+index+b*16,8);
+      offset = read_memory(data+index+b*16+8,8);
+
+      if (offset < last_offset || offset > index) return FALSE;
+      if (key < last_key) return FALSE;
+
+      last_offset = offset;
+      last_key = key;
+   }
+
+   pack->data = data;
+   pack->size = (int) entry_nb;
+   pack->block_nb = (int) block_nb;
+   pack->index = data + index;
+
+   return TRUE;
+}
+
+// book_pack_block()
+
+int book_pack_block(const book_pack_t * pack, int block, book_entry_t entry[]) {
+
+   const uint8 * p;
+   const uint8 * end;
+   uint64 key, delta;
+   uint32 tag;
+   int size;
+   int len;
+   int i;
+
+   ASSERT(pack!=NULL);
+   ASSERT(block>=0&&block<pack->block_nb);
+   ASSERT(entry!=NULL);
+
+   // returns -1 for a block that does not decode within its bytes
+
+   size = pack->size - block * PackBlockSize;
+   if (size > PackBlockSize) size = PackBlockSize;
+
+   p = pack->data + block_offset(pack,block);
+   end = pack->data + block_end(pack,block);
+   key = block_key(pack,block);
+
+   for (i = 0; i < size; i++) {
+
+      if (end - p < 3) return -1;
+
+      tag = p[0] | (p[1] << 8) | (p[2] << 16);
+      p += 3;
+
+      len = (tag >> TagDeltaShift) & 15;
+      if (len > 8) return -1;
+      if (end - p < len + (((tag & TagWide) != 0) ? 2 : 1) + (((tag & TagLearn) != 0) ? 4 : 0)) return -1;
+
+      delta = 0;
+      while (len > 0) delta = (delta << 8) | p[--len];
+      p += (tag >> TagDeltaShift) & 15;
+
+      key += delta;
+
+      entry[i].key = key;
+      entry[i].move = tag & TagMoveMask;
+
+      if ((tag & TagWide) != 0) {
+         entry[i].count = p[0] | (p[1] << 8);
+         p += 2;
+      } else {
+         entry[i].count = p[0];
+         p += 1;
+      }
+
+      if ((tag & TagLearn) != 0) {
+         entry[i].n = p[0] | (p[1] << 8);
+         entry[i].sum = p[2] | (p[3] << 8);
+         p += 4;
+      } else {
+         entry[i].n = 0;
+         entry[i].sum = 0;
+      }
+   }
+
+   return size;
+}
+
+// book_pack_check()
+
+int book_pack_check(const book_pack_t * pack) {
+
+   book_entry_t entry[PackBlockSize];
+   int block;
+   int bad_nb;
+
+   ASSERT(pack!=NULL);
+
+   // number of blocks that do not decode
+
+   bad_nb = 0;
+
+   for (block = 0; block < pack->block_nb; block++) {
+      if (book_pack_block(pack,block,entry) < 0) bad_nb++;
+   }
+
+   return bad_nb;
+}
+
+// book_pack_find()
+
+int book_pack_find(const book_pack_t * pack, uint64 key) {
+
+   book_entry_t entry[PackBlockSize];
+   int left, right, mid;
+   int block;
+   int size;
+   int i;
+
+   ASSERT(pack!=NULL);
+
+   if (pack->block_nb == 0) return pack->size;
+
+   // first block starting at or after the key
+
+   left = 0;
+   right = pack->block_nb;
+
+   while (left < right) {
+      mid = (left + right) / 2;
+      if (block_key(pack,mid) < key) {
+         left = mid+1;
+      } else {
+         right = mid;
+      }
+   }
+
+   // the position can start at the end of the block before
+
+   block = (left > 0) ? left-1 : 0;
+
+   size = book_pack_block(pack,block,entry);
+   if (size < 0) return pack->size;
+
+   for (i = 0; i < size; i++) {
+      if (entry[i].key == key) return block * PackBlockSize + i;
+      if (entry[i].key > key) return pack->size;
+   }
+
+   if (left < pack->block_nb && left != block && block_key(pack,left) == key) {
+      return left * PackBlockSize;
+   }
+
+   return pack->size;
+}
+
+// book_pack_entries()
+
+int book_pack_entries(const book_pack_t * pack, uint64 key, book_entry_t entry[], int size) {
+
+   book_entry_t block[PackBlockSize];
+   int block_size;
+   int pos;
+   int b, i;
+   int n;
+
+   ASSERT(pack!=NULL);
+   ASSERT(entry!=NULL);
+   ASSERT(size>0);
+
+   pos = book_pack_find(pack,key);
+   if (pos >= pack->size) return 0;
+
+   n = 0;
+
+   for (b = pos / PackBlockSize; b < pack->block_nb; b++) {
+
+      block_size = book_pack_block(pack,b,block);
+      if (block_size < 0) return n;
+
+      for (i = (b == pos / PackBlockSize) ? pos % PackBlockSize : 0; i < block_size; i++) {
+         if (block[i].key != key || n == size) return n;
+         entry[n++] = block[i];
+      }
+   }
+
+   return n;
+}
+
+// book_pack_create()
+
+void book_pack_create(book_pack_writer_t * writer, const char file_name[]) {
+
+   uint8 header[PackHeaderSize];
+
+   ASSERT(writer!=NULL);
+   ASSERT(file_name!=NULL);
+
+   writer->file = fopen(file_name,"wb");
+   if (writer->file == NULL) my_fatal("book_pack_create(): can't open file \"%s\" for writing: %s\n",file_name,strerror(errno));
+
+   writer->size = 0;
+   writer->block_nb = 0;
+   writer->block_alloc = 1024;
+   writer->block_key = (uint64 *) my_malloc(writer->block_alloc*sizeof(uint64));
+   writer->block_offset = (uint64 *) my_malloc(writer->block_alloc*sizeof(uint64));
+   writer->offset = PackHeaderSize;
+   writer->last_key = U64(0x0);
+   writer->buffer_size = 0;
+
+   // the counts are filled in by book_pack_finish(), until then the
+   // book is recognised as packed but fails book_pack_open()
+
+   memset(header,0,PackHeaderSize);
+   memcpy(header,PackMagic,8);
+   if (fwrite(header,1,PackHeaderSize,writer->file) != PackHeaderSize) {
+      my_fatal("book_pack_create(): fwrite(): %s\n",strerror(errno));
+   }
+}
+
+// book_pack_write()
+
+void book_pack_write(book_pack_writer_t * writer, const book_entry_t * entry) {
+
+   uint8 * p;
+   uint64 delta;
+   uint32 tag;
+   int len;
+
+   ASSERT(writer!=NULL);
+   ASSERT(entry!=NULL);
+
+   // checked before a block start resets the delta base
+
+   if (entry->key < writer->last_key) my_fatal("book_pack_write(): entries not sorted\n");
+
+   if (writer->size % PackBlockSize == 0) {
+
+      if (writer->size != 0) block_flush(writer);
+
+      if (writer->block_nb == writer->block_alloc) {
+         writer->block_alloc *= 2;
+         writer->block_key = (uint64 *) my_realloc(writer->block_key,writer->block_alloc*sizeof(uint64));
+         writer->block_offset = (uint64 *) my_realloc(writer->block_offset,writer->block_alloc*sizeof(uint64));
+      }
+
+      writer->block_key[writer->block_nb] = entry->key;
+      writer->block_offset[writer->block_nb] = writer->offset;
+      writer->block_nb++;
+      writer->last_key = entry->key;
+   }
+
+   delta = entry->key - writer->last_key;
+   writer->last_key = entry->key;
+
+   for (len = 0; len < 8 && (delta >> (len*8)) != 0; len++)
+      ;
+
+   tag = entry->move | (len << TagDeltaShift);
+   if (entry->n != 0 || entry->sum != 0) tag |= TagLearn;
+   if (entry->count > 0xFF) tag |= TagWide;
+
+   p = &writer->buffer[writer->buffer_size];
+
+   *p++ = tag & 0xFF;
+   *p++ = (tag >> 8) & 0xFF;
+   *p++ = (tag >> 16) & 0xFF;
+
+   for (; len > 0; len--) {
+      *p++ = delta & 0xFF;
+      delta >>= 8;
+   }
+
+   *p++ = entry->count & 0xFF;
+   if ((tag & TagWide) != 0) *p++ = entry->count >> 8;
+
+   if ((tag & TagLearn) != 0) {
+      *p++ = entry->n & 0xFF;
+      *p++ = entry->n >> 8;
+      *p++ = entry->sum & 0xFF;
+      *p++ = entry->sum >> 8;
+   }
+
+   writer->buffer_size = p - writer->buffer;
+   writer->size++;
+}
+
+// book_pack_finish()
+
+void book_pack_finish(book_pack_writer_t * writer) {
+
+   int block;
+
+   ASSERT(writer!=NULL);
+
+   if (writer->buffer_size != 0) block_flush(writer);
+
+   // block index: first key and offset of every block
+
+   for (block = 0; block < writer->block_nb; block++) {
+      write_integer(writer->file,8,writer->block_key[block]);
+      write_integer(writer->file,8,writer->block_offset[block]);
+   }
+
+   if (fseek(writer->file,0,SEEK_SET) == -1) {
+      my_fatal("book_pack_finish(): fseek(): %s\n",strerror(errno));
+   }
+
+   if (fwrite(PackMagic,1,8,writer->file) != 8) {
+      my_fatal("book_pack_finish(): fwrite(): %s\n",strerror(errno));
+   }
+
+   write_integer(writer->file,8,writer->size);
+   write_integer(writer->file,4,PackBlockSize);
+   write_integer(writer->file,4,writer->block_nb);
+   write_integer(writer->file,8,writer->offset);
+
+   if (fclose(writer->file) == EOF) {
+      my_fatal("book_pack_finish(): fclose(): %s\n",strerror(errno));
+   }
+
+   my_free(writer->block_key);
+   my_free(writer->block_offset);
+}
+
+// book_pack()
+
+void book_pack(int argc, char * argv[]) {
+
+   const char * bin_file;
+   const char * out_file;
+   book_pack_writer_t writer[1];
+   book_entry_t entry[1];
+   FILE * file;
+   int i;
+
+   bin_file = "book.bin";
+   out_file = NULL;
+
+   for (i = 1; i < argc; i++) {
+
+      if (FALSE) {
+
+      } else if (my_string_equal(argv[i],"pack-book")) {
+
+         // skip
+
+      } else if (my_string_equal(argv[i],"-bin")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_pack(): missing argument\n");
+
+         bin_file = argv[i];
+
+      } else if (my_string_equal(argv[i],"-out")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_pack(): missing argument\n");
+
+         out_file = argv[i];
+
+      } else {
+
+         my_fatal("book_pack(): unknown option \"%s\"\n",argv[i]);
+      }
+   }
+
+   if (out_file == NULL) my_fatal("book_pack(): you must give -out\n");
+
+   file = fopen(bin_file,"rb");
+   if (file == NULL) my_fatal("book_pack(): can't open file \"%s\": %s\n",bin_file,strerror(errno));
+   if (book_pack_detect(file)) my_fatal("book_pack(): \"%s\" is already packed\n",bin_file);
+
+   setvbuf(file,NULL,_IOFBF,ReadBufferSize);
+
+   book_pack_create(writer,out_file);
+   while (read_entry(file,entry)) book_pack_write(writer,entry);
+   book_pack_finish(writer);
+
+   fclose(file);
+
+   printf("packed %d entries\n",writer->size);
+}
+
+// book_unpack()
+
+void book_unpack(int argc, char * argv[]) {
+
+   const char * bin_file;
+   const char * out_file;
+   book_pack_t pack[1];
+   book_entry_t entry[PackBlockSize];
+   uint8 * data;
+   FILE * file;
+   long size;
+   int block, block_size;
+   int i;
+
+   bin_file = "book.pgp";
+   out_file = NULL;
+
+   for (i = 1; i < argc; i++) {
+
+      if (FALSE) {
+
+      } else if (my_string_equal(argv[i],"unpack-book")) {
+
+         // skip
+
+      } else if (my_string_equal(argv[i],"-bin")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_unpack(): missing argument\n");
+
+         bin_file = argv[i];
+
+      } else if (my_string_equal(argv[i],"-out")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_unpack(): missing argument\n");
+
+         out_file = argv[i];
+
+      } else {
+
+         my_fatal("book_unpack(): unknown option \"%s\"\n",argv[i]);
+      }
+   }
+
+   if (out_file == NULL) my_fatal("book_unpack(): you must give -out\n");
+
+   file = fopen(bin_file,"rb");
+   if (file == NULL) my_fatal("book_unpack(): can't open file \"%s\": %s\n",bin_file,strerror(errno));
+
+   fseek(file,0,SEEK_END);
+   size = ftell(file);
+   fseek(file,0,SEEK_SET);
+
+   data = (uint8 *) my_malloc(size+1);
+   if (fread(data,1,size,file) != (size_t)size) {
+      my_fatal("book_unpack(): fread(): %s\n",strerror(errno));
+   }
+   fclose(file);
+
+   if (!book_pack_open(pack,data,size)) my_fatal("book_unpack(): \"%s\" is not a packed book\n",bin_file);
+
+   file = fopen(out_file,"wb");
+   if (file == NULL) my_fatal("book_unpack(): can't open file \"%s\" for writing: %s\n",out_file,strerror(errno));
+
+   setvbuf(file,NULL,_IOFBF,ReadBufferSize);
+
+   for (block = 0; block < pack->block_nb; block++) {
+      block_size = book_pack_block(pack,block,entry);
+      if (block_size < 0) {
+         my_fatal("book_unpack(): \"%s\" is corrupted, block %d does not decode\n",bin_file,block);
+         break;
+      }
+      for (i = 0; i < block_size; i++) write_entry(file,&entry[i]);
+   }
+
+   if (fclose(file) == EOF) my_fatal("book_unpack(): fclose(): %s\n",strerror(errno));
+
+   my_free(data);
+
+   printf("unpacked %d entries\n",pack->size);
+}
+
+// block_flush()
+
+static void block_flush(book_pack_writer_t * writer) {
+
+   ASSERT(writer!=NULL);
+
+   if (fwrite(writer->buffer,1,writer->buffer_size,writer->file) != (size_t)writer->buffer_size) {
+      my_fatal("block_flush(): fwrite(): %s\n",strerror(errno));
+   }
+
+   writer->offset += writer->buffer_size;
+   writer->buffer_size = 0;
+}
+
+// block_key()
+
+static uint64 block_key(const book_pack_t * pack, int block) {
+
+   return read_memory(pack->index+((size_t)block)*16,8);
+}
+
+// block_offset()
+
+static uint64 block_offset(const book_pack_t * pack, int block) {
+
+   return read_memory(pack->index+((size_t)block)*16+8,8);
+}
+
+// block_end()
+
+static uint64 block_end(const book_pack_t * pack, int block) {
+
+   // the next block, or the index after the last one
+
+   if (block+1 < pack->block_nb) return block_offset(pack,block+1);
+
+   return pack->index - pack->data;
+}
+
+// read_memory()
+
+static uint64 read_memory(const uint8 * address, int size) {
+
+   uint64 n;
+   int i;
+
+   ASSERT(address!=NULL);
+   ASSERT(size>0&&size<=8);
+
+   n = 0;
+
+   for (i = 0; i < size; i++) n = (n << 8) | address[i];
+
+   return n;
+}
+
+// read_entry()
+
+static bool read_entry(FILE * file, book_entry_t * entry) {
+
+   uint8 buffer[16];
+
+   ASSERT(file!=NULL);
+   ASSERT(entry!=NULL);
+
+   if (fread(buffer,1,16,file) != 16) return FALSE;
+
+   entry->key   = read_memory(buffer,8);
+   entry->move  = read_memory(buffer+8,2);
+   entry->count = read_memory(buffer+10,2);
+   entry->n     = read_memory(buffer+12,2);
+   entry->sum   = read_memory(buffer+14,2);
+
+   return TRUE;
+}
+
+// write_integer()
+
+static void write_integer(FILE * file, int size, uint64 n) {
+
+   int i;
+   int b;
+
+   ASSERT(file!=NULL);
+   ASSERT(size>0&&size<=8);
+   ASSERT(size==8||n>>(size*8)==0);
+
+   for (i = size-1; i >= 0; i--) {
+
+      b = (n >> (i*8)) & 0xFF;
+      ASSERT(b>=0&&b<256);
+
+      if (fputc(b,file) == EOF) {
+         my_fatal("write_integer(): fputc(): %s\n",strerror(errno));
+      }
+   }
+}
+
+// write_entry()
+
+static void write_entry(FILE * file, const book_entry_t * entry) {
+
+   ASSERT(file!=NULL);
+   ASSERT(entry!=NULL);
+
+   write_integer(file,8,entry->key);
+   write_integer(file,2,entry->move);
+   write_integer(file,2,entry->count);
+   write_integer(file,2,entry->n);
+   write_integer(file,2,entry->sum);
+}
+
+// end of book_pack.c
@@ -0,0 +1,69 @@
+
+// book_pack.h
+
+#ifndef BOOK_PACK_H
+#define BOOK_PACK_H
+
+// includes
+
+#include <stdio.h>
+
+#include "util.h"
+
+// constants
+
+#define PackBlockSize  64 // entries
+#define PackHeaderSize 32
+
+// types
+
+typedef struct {
+   uint64 key;
+   uint16 move;
+   uint16 count;
+   uint16 n;
+   uint16 sum;
+} book_entry_t;
+
+typedef struct {
+   const uint8 * data;
+   int size;
+   int block_nb;
+   const uint8 * index;
+} book_pack_t;
+
+typedef struct {
+   FILE * file;
+   int size;
+   int block_nb;
+   int block_alloc;
+   uint64 * block_key;
+   uint64 * block_offset;
+   uint64 offset;
+   uint64 last_key;
+   int buffer_size;
+   uint8 buffer[PackBlockSize*17];
+} book_pack_writer_t;
+
+// functions
+
+extern bool book_pack_detect  (FILE * file);
+
+extern void book_pack_clear   (book_pack_t * pack);
+extern bool book_pack_open    (book_pack_t * pack, const uint8 data[], size_t size);
+
+extern int  book_pack_block   (const book_pack_t * pack, int block, book_entry_t entry[]);
+extern int  book_pack_check   (const book_pack_t * pack);
+extern int  book_pack_find    (const book_pack_t * pack, uint64 key);
+extern int  book_pack_entries (const book_pack_t * pack, uint64 key, book_entry_t entry[], int size);
+
+extern void book_pack_create  (book_pack_writer_t * writer, const char file_name[]);
+extern void book_pack_write   (book_pack_writer_t * writer, const book_entry_t * entry);
+extern void book_pack_finish  (book_pack_writer_t * writer);
+
+extern void book_pack         (int argc, char * argv[]);
+extern void book_unpack       (int argc, char * argv[]);
+
+#endif // !defined BOOK_PACK_H
+
+// end of book_pack.h
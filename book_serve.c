@@ -0,0 +1,1167 @@
+
+// book_serve.c
+
+// includes
+
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "board.h"
+#include "book.h"
+#include "book_serve.h"
+#include "fen.h"
+#include "move.h"
+#include "move_legal.h"
+#include "option.h"
+#include "thread.h"
+#include "util.h"
+
+// constants
+
+#define BookMax    16
+#define LineSize   65536
+#define ReplySize  65536
+#define EntryMax   256
+#define BatchSize  16
+#define LatencyNb  256 // eighths of an octave of microseconds
+#define WatchStep  100 // milliseconds
+
+// types
+
+typedef struct {
+   book_file_t book[1];
+   int ref_nb;
+   struct stat stat[1];
+} snapshot_t;
+
+typedef struct session_t session_t;
+
+typedef struct job_t {
+   struct job_t * next;
+   session_t * session;
+   snapshot_t * snapshot;
+   char * request;
+   char * reply;
+   double start;
+   bool probe;
+   bool done;
+} job_t;
+
+typedef struct {
+   job_t * head;
+   job_t * tail;
+   int nb;
+} job_list_t;
+
+struct session_t {
+   FILE * out;
+   int book;
+   my_mutex_t mutex[1];
+   my_cond_t cond[1];
+   job_t ** ring;
+   int ring_size;
+   int head;
+   int pending;
+};
+
+// variables
+
+static snapshot_t * Book[BookMax];
+static struct stat BookSeen[BookMax];
+static const char * BookName[BookMax];
+static int BookNb;
+
+static my_mutex_t BookMutex[1];
+static my_mutex_t ReloadMutex[1];
+
+static bool BookCopy;
+
+static int WatchPeriod;
+static bool WatchStop;
+
+static int QueueSize;
+
+static my_mutex_t QueueMutex[1];
+static my_cond_t QueueCond[1];
+static job_t * QueueHead;
+static job_t * QueueTail;
+static bool QueueStop;
+
+static my_mutex_t StatsMutex[1];
+static uint64 StatsCount;
+static double StatsSum;
+static double StatsMax;
+static uint64 StatsLatency[LatencyNb];
+
+// prototypes
+
+static void   session_run    (int in, FILE * out);
+static bool   session_request (session_t * session, job_list_t * batch, char request[]);
+static void   session_flush  (session_t * session);
+
+static job_t * job_new       (session_t * session, const char request[]);
+static void   job_free       (job_t * job);
+static void   job_answer     (job_t * job);
+static void   job_complete   (job_t * job);
+
+static void   answer_fen     (const book_file_t * book, const char fen[], char line[], int size);
+static void   answer_key     (const book_file_t * book, const char token[], char line[], int size);
+static void   reply_add      (char reply[], int * pos, const char line[]);
+
+static snapshot_t * snapshot_open    (const char file_name[], const struct stat * stat);
+static snapshot_t * snapshot_acquire (int book);
+static void         snapshot_release (snapshot_t * snapshot);
+
+static int    book_reload    (int book, bool force);
+static bool   stat_equal     (const struct stat * stat_1, const struct stat * stat_2);
+static void   watcher        (void * arg);
+
+static void   queue_push     (job_list_t * batch);
+static void   worker         (void * arg);
+
+static void   stats_add      (double latency);
+static void   stats_string   (char string[], int size);
+
+static bool   parse_key      (const char string[], uint64 * key);
+
+#ifndef _WIN32
+static void   serve_socket   (const char path[]);
+static void   socket_session (void * arg);
+#endif
+
+// functions
+
+// book_serve()
+
+void book_serve(int argc, char * argv[]) {
+
+   int i;
+   const char * socket_path;
+   int thread_nb;
+   my_thread_t * thread;
+   my_thread_t watch_thread;
+   char string[StringSize];
+
+   BookNb = 0;
+   socket_path = NULL;
+   thread_nb = my_cpu_nb();
+   QueueSize = 1024;
+   BookCopy = FALSE;
+   WatchPeriod = 1000;
+
+   for (i = 1; i < argc; i++) {
+
+      if (FALSE) {
+
+      } else if (my_string_equal(argv[i],"serve-book")) {
+
+         // skip
+
+      } else if (my_string_equal(argv[i],"-bin")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_serve(): missing argument\n");
+         if (BookNb >= BookMax) my_fatal("book_serve(): too many books\n");
+
+         BookName[BookNb++] = argv[i];
+
+      } else if (my_string_equal(argv[i],"-threads")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_serve(): missing argument\n");
+
+         thread_nb = atoi(argv[i]);
+         if (thread_nb < 1) my_fatal("book_serve(): bad thread number\n");
+
+      } else if (my_string_equal(argv[i],"-queue")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_serve(): missing argument\n");
+
+         QueueSize = atoi(argv[i]);
+         if (QueueSize < 1) my_fatal("book_serve(): bad queue size\n");
+
+      } else if (my_string_equal(argv[i],"-socket")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_serve(): missing argument\n");
+
+         socket_path = argv[i];
+
+      } else if (my_string_equal(argv[i],"-copy")) {
+
+         BookCopy = TRUE;
+
+      } else if (my_string_equal(argv[i],"-watch")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_serve(): missing argument\n");
+
+         WatchPeriod = atoi(argv[i]);
+         if (WatchPeriod < 0) my_fatal("book_serve(): bad watch period\n");
+
+      } else {
+
+         my_fatal("book_serve(): unknown option \"%s\"\n",argv[i]);
+      }
+   }
+
+   if (BookNb == 0) BookName[BookNb++] = "book.bin";
+
+   // books are read-only snapshots, replaced as a whole on reload
+
+   option_init_pg();
+
+   my_mutex_init(BookMutex);
+   my_mutex_init(ReloadMutex);
+
+   for (i = 0; i < BookNb; i++) {
+      if (stat(BookName[i],&BookSeen[i]) == -1 || (Book[i] = snapshot_open(BookName[i],&BookSeen[i])) == NULL) {
+         my_fatal("book_serve(): can't open book \"%s\"\n",BookName[i]);
+      }
+   }
+
+   // worker pool
+
+   my_mutex_init(QueueMutex);
+   my_cond_init(QueueCond);
+   QueueHead = NULL;
+   QueueTail = NULL;
+   QueueStop = FALSE;
+
+   my_mutex_init(StatsMutex);
+   StatsCount = 0;
+   StatsSum = 0.0;
+   StatsMax = 0.0;
+   memset(StatsLatency,0,sizeof(StatsLatency));
+
+   thread = (my_thread_t *) my_malloc(thread_nb*sizeof(my_thread_t));
+   for (i = 0; i < thread_nb; i++) my_thread_create(&thread[i],worker,NULL);
+
+   WatchStop = FALSE;
+   if (WatchPeriod != 0) my_thread_create(&watch_thread,watcher,NULL);
+
+   if (socket_path != NULL) {
+#ifndef _WIN32
+      serve_socket(socket_path);
+#else
+      my_fatal("book_serve(): sockets are not supported on this platform\n");
+#endif
+   } else {
+      setvbuf(stdout,NULL,_IOFBF,LineSize);
+      session_run(STDIN_FILENO,stdout);
+   }
+
+   // shutdown
+
+   if (WatchPeriod != 0) {
+      my_mutex_lock(ReloadMutex);
+      WatchStop = TRUE;
+      my_mutex_unlock(ReloadMutex);
+      my_thread_join(&watch_thread);
+   }
+
+   my_mutex_lock(QueueMutex);
+   QueueStop = TRUE;
+   my_cond_broadcast(QueueCond);
+   my_mutex_unlock(QueueMutex);
+
+   for (i = 0; i < thread_nb; i++) my_thread_join(&thread[i]);
+   my_free(thread);
+
+   stats_string(string,StringSize);
+   fprintf(stderr,"%s\n",string);
+
+   for (i = 0; i < BookNb; i++) snapshot_release(Book[i]);
+
+   my_mutex_free(ReloadMutex);
+   my_mutex_free(BookMutex);
+   my_mutex_free(StatsMutex);
+   my_cond_free(QueueCond);
+   my_mutex_free(QueueMutex);
+}
+
+// session_run()
+
+static void session_run(int in, FILE * out) {
+
+   session_t session[1];
+   job_list_t batch[1];
+   char * buffer;
+   int size, start, end;
+   int n;
+   bool eof, quit;
+
+   ASSERT(in>=0);
+   ASSERT(out!=NULL);
+
+   session->out = out;
+   session->book = 0;
+   my_mutex_init(session->mutex);
+   my_cond_init(session->cond);
+   session->ring = (job_t **) my_malloc(QueueSize*sizeof(job_t *));
+   session->ring_size = QueueSize;
+   session->head = 0;
+   session->pending = 0;
+
+   batch->head = NULL;
+   batch->tail = NULL;
+   batch->nb = 0;
+
+   buffer = (char *) my_malloc(LineSize+1);
+   size = 0;
+
+   // requests are pipelined: reading goes on while earlier ones are
+   // answered, replies leave in request order. The lines that arrive
+   // with one read() are handed to the workers as one batch.
+
+   eof = FALSE;
+   quit = FALSE;
+
+   while (!eof && !quit) {
+
+      n = read(in,&buffer[size],LineSize-size);
+
+      if (n > 0) {
+         size += n;
+      } else {
+         if (n < 0 && errno == EINTR) continue;
+         eof = TRUE;
+         buffer[size++] = '\n'; // unterminated last line
+      }
+
+      start = 0;
+
+      for (end = 0; end < size && !quit; end++) {
+         if (buffer[end] == '\n') {
+            buffer[end] = '\0';
+            quit = !session_request(session,batch,&buffer[start]);
+            start = end + 1;
+         }
+      }
+
+      if (start == 0 && size == LineSize) { // overlong line
+         buffer[size] = '\0';
+         quit = !session_request(session,batch,buffer);
+         start = size;
+      }
+
+      size -= start;
+      memmove(buffer,&buffer[start],size);
+
+      queue_push(batch);
+   }
+
+   // drain
+
+   my_mutex_lock(session->mutex);
+   while (session->pending != 0) my_cond_wait(session->cond,session->mutex);
+   my_mutex_unlock(session->mutex);
+
+   my_free(buffer);
+   my_free(session->ring);
+   my_cond_free(session->cond);
+   my_mutex_free(session->mutex);
+}
+
+// session_request()
+
+static bool session_request(session_t * session, job_list_t * batch, char request[]) {
+
+   job_t * job;
+   char string[StringSize];
+   int i, n;
+
+   ASSERT(session!=NULL);
+   ASSERT(batch!=NULL);
+   ASSERT(request!=NULL);
+
+   // CRs, leading blanks and empty lines are ignored
+
+   for (i = n = 0; request[i] != '\0'; i++) {
+      if (request[i] != '\r') request[n++] = request[i];
+   }
+   request[n] = '\0';
+
+   while (*request == ' ' || *request == '\t') request++;
+   if (*request == '\0') return TRUE;
+
+   if (my_string_equal(request,"quit")) return FALSE;
+
+   job = job_new(session,request);
+
+   if (FALSE) {
+
+   } else if (strncmp(request,"fen ",4) == 0 || strncmp(request,"key ",4) == 0) {
+
+      // probes are answered from the snapshot current at parse time
+
+      job->snapshot = snapshot_acquire(session->book);
+      job->probe = TRUE;
+
+   } else if (strncmp(request,"use ",4) == 0) {
+
+      // takes effect for the requests that follow
+
+      n = atoi(&request[4]);
+
+      if (n >= 0 && n < BookNb) {
+         session->book = n;
+         job->reply = my_strdup("ok\n");
+      } else {
+         job->reply = my_strdup("error bad book\n");
+      }
+
+   } else if (my_string_equal(request,"books")) {
+
+      n = snprintf(string,StringSize,"ok %d",BookNb);
+      for (i = 0; i < BookNb && n < StringSize; i++) {
+         n += snprintf(&string[n],StringSize-n," %s",BookName[i]);
+      }
+      if (n >= StringSize - 1) n = StringSize - 2;
+      strcpy(&string[n],"\n");
+      job->reply = my_strdup(string);
+
+   } else if (my_string_equal(request,"reload")) {
+
+      // forced, even if the files look unchanged
+
+      n = 0;
+
+      for (i = 0; i < BookNb; i++) {
+         if (book_reload(i,TRUE) > 0) n++;
+      }
+
+      snprintf(string,StringSize,(n == BookNb) ? "ok %d\n" : "error reloaded %d\n",n);
+      job->reply = my_strdup(string);
+
+   } else if (my_string_equal(request,"stats")) {
+
+      stats_string(string,StringSize-1);
+      strcat(string,"\n");
+      job->reply = my_strdup(string);
+
+   } else {
+
+      job->reply = my_strdup("error unknown command\n");
+   }
+
+   job->done = !job->probe;
+
+   my_mutex_lock(session->mutex);
+
+   if (session->pending == session->ring_size && batch->nb != 0) {
+
+      // the oldest replies may be waiting in our own batch
+
+      my_mutex_unlock(session->mutex);
+      queue_push(batch);
+      my_mutex_lock(session->mutex);
+   }
+
+   while (session->pending == session->ring_size) {
+      my_cond_wait(session->cond,session->mutex);
+   }
+
+   session->ring[(session->head+session->pending)%session->ring_size] = job;
+   session->pending++;
+
+   if (job->done) session_flush(session);
+
+   my_mutex_unlock(session->mutex);
+
+   if (!job->done) {
+
+      job->next = NULL;
+
+      if (batch->tail != NULL) {
+         batch->tail->next = job;
+      } else {
+         batch->head = job;
+      }
+
+      batch->tail = job;
+      batch->nb++;
+   }
+
+   return TRUE;
+}
+
+// session_flush()
+
+static void session_flush(session_t * session) {
+
+   job_t * job;
+   bool written;
+
+   ASSERT(session!=NULL);
+
+   // called with the session locked
+
+   written = FALSE;
+
+   while (session->pending != 0) {
+
+      job = session->ring[session->head];
+      if (!job->done) break;
+
+      fputs(job->reply,session->out);
+      if (job->probe) stats_add(now_real()-job->start);
+
+      job_free(job);
+      session->head = (session->head + 1) % session->ring_size;
+      session->pending--;
+      written = TRUE;
+   }
+
+   // replies still owed keep the stream buffered, the last one flushes it
+
+   if (written) {
+      if (session->pending == 0) fflush(session->out);
+      my_cond_broadcast(session->cond);
+   }
+}
+
+// job_new()
+
+static job_t * job_new(session_t * session, const char request[]) {
+
+   job_t * job;
+
+   ASSERT(session!=NULL);
+   ASSERT(request!=NULL);
+
+   job = (job_t *) my_malloc(sizeof(job_t));
+
+   job->next = NULL;
+   job->session = session;
+   job->snapshot = NULL;
+   job->request = my_strdup(request);
+   job->reply = NULL;
+   job->start = now_real();
+   job->probe = FALSE;
+   job->done = FALSE;
+
+   return job;
+}
+
+// job_free()
+
+static void job_free(job_t * job) {
+
+   ASSERT(job!=NULL);
+
+   my_free(job->request);
+   if (job->reply != NULL) my_free(job->reply);
+   my_free(job);
+}
+
+// job_answer()
+
+static void job_answer(job_t * job) {
+
+   char reply[ReplySize];
+   char line[StringSize];
+   char * token;
+   char * next;
+   int pos;
+
+   ASSERT(job!=NULL);
+   ASSERT(job->snapshot!=NULL);
+
+   reply[0] = '\0';
+   pos = 0;
+
+   if (strncmp(job->request,"fen ",4) == 0) {
+
+      // one reply line per ';' separated FEN
+
+      for (token = &job->request[4]; token != NULL; token = next) {
+
+         next = strchr(token,';');
+         if (next != NULL) *next++ = '\0';
+
+         while (*token == ' ' || *token == '\t') token++;
+
+         answer_fen(job->snapshot->book,token,line,StringSize);
+         reply_add(reply,&pos,line);
+      }
+
+   } else {
+
+      // one reply line per key
+
+      for (token = &job->request[4]; *token != '\0'; token = next) {
+
+         while (*token == ' ' || *token == '\t') token++;
+         if (*token == '\0') break;
+
+         for (next = token; *next != '\0' && *next != ' ' && *next != '\t'; next++)
+            ;
+         if (*next != '\0') *next++ = '\0';
+
+         answer_key(job->snapshot->book,token,line,StringSize);
+         reply_add(reply,&pos,line);
+      }
+   }
+
+   job->reply = my_strdup(reply);
+
+   // the last probe of a replaced book unmaps it
+
+   snapshot_release(job->snapshot);
+   job->snapshot = NULL;
+}
+
+// job_complete()
+
+static void job_complete(job_t * job) {
+
+   session_t * session;
+
+   ASSERT(job!=NULL);
+
+   session = job->session;
+
+   my_mutex_lock(session->mutex);
+   job->done = TRUE;
+   session_flush(session);
+   my_mutex_unlock(session->mutex);
+}
+
+// answer_fen()
+
+static void answer_fen(const book_file_t * book, const char fen[], char line[], int size) {
+
+   board_t board[1];
+   book_entry_t entry[EntryMax];
+   char move_string[16];
+   int entry_nb;
+   int move_nb;
+   int pos;
+   int i;
+
+   ASSERT(book!=NULL);
+   ASSERT(fen!=NULL);
+   ASSERT(line!=NULL);
+
+   if (!fen_is_ok(fen)) {
+      snprintf(line,size,"error bad fen");
+      return;
+   }
+
+   board_from_fen(board,fen);
+
+   entry_nb = book_file_entries(book,board->key,entry,EntryMax);
+
+   move_nb = 0;
+
+   for (i = 0; i < entry_nb; i++) {
+      if (entry[i].move != MoveNone && move_is_legal(entry[i].move,board)) {
+         entry[move_nb++] = entry[i];
+      }
+   }
+
+   pos = snprintf(line,size,"ok %d",move_nb);
+
+   for (i = 0; i < move_nb && pos < size; i++) {
+      move_to_can(entry[i].move,board,move_string,16);
+      pos += snprintf(&line[pos],size-pos," %s %d",move_string,entry[i].count);
+   }
+}
+
+// answer_key()
+
+static void answer_key(const book_file_t * book, const char token[], char line[], int size) {
+
+   uint64 key;
+   book_entry_t entry[EntryMax];
+   char move_string[16];
+   int entry_nb;
+   int pos;
+   int i;
+
+   ASSERT(book!=NULL);
+   ASSERT(token!=NULL);
+   ASSERT(line!=NULL);
+
+   if (!parse_key(token,&key)) {
+      snprintf(line,size,"error bad key");
+      return;
+   }
+
+   // without a position, moves are given in raw book coordinates
+
+   entry_nb = book_file_entries(book,key,entry,EntryMax);
+
+   pos = snprintf(line,size,"ok %d",entry_nb);
+
+   for (i = 0; i < entry_nb && pos < size; i++) {
+      move_to_coord(entry[i].move,move_string);
+      pos += snprintf(&line[pos],size-pos," %s %d",move_string,entry[i].count);
+   }
+}
+
+// reply_add()
+
+static void reply_add(char reply[], int * pos, const char line[]) {
+
+   int len;
+
+   ASSERT(reply!=NULL);
+   ASSERT(pos!=NULL);
+   ASSERT(line!=NULL);
+
+   len = strlen(line);
+
+   if (len >= StringSize - 1) {
+      line = "error reply too long";
+      len = strlen(line);
+   }
+
+   if (*pos + len + 2 > ReplySize) {
+      line = "error reply too long";
+      len = strlen(line);
+      if (*pos + len + 2 > ReplySize) return;
+   }
+
+   memcpy(&reply[*pos],line,len);
+   *pos += len;
+   reply[(*pos)++] = '\n';
+   reply[*pos] = '\0';
+}
+
+// snapshot_open()
+
+static snapshot_t * snapshot_open(const char file_name[], const struct stat * stat) {
+
+   snapshot_t * snapshot;
+
+   ASSERT(file_name!=NULL);
+   ASSERT(stat!=NULL);
+
+   // a file caught while being written in place is not a book
+
+   if (stat->st_size == 0) return NULL;
+
+   snapshot = (snapshot_t *) my_malloc(sizeof(snapshot_t));
+
+   if (!book_file_open(snapshot->book,file_name)) {
+      my_free(snapshot);
+      return NULL;
+   }
+
+   // packed books check their own header and block index instead
+
+   if (snapshot->book->pack->data == NULL && stat->st_size % 16 != 0) {
+      book_file_close(snapshot->book);
+      my_free(snapshot);
+      return NULL;
+   }
+
+   // workers probe concurrently, which an unmapped book read through its
+   // one FILE would not survive
+
+   if (BookCopy || snapshot->book->data == NULL) book_file_copy(snapshot->book);
+
+   snapshot->ref_nb = 1; // the book table's reference
+   *snapshot->stat = *stat;
+
+   return snapshot;
+}
+
+// snapshot_acquire()
+
+static snapshot_t * snapshot_acquire(int book) {
+
+   snapshot_t * snapshot;
+
+   ASSERT(book>=0&&book<BookNb);
+
+   my_mutex_lock(BookMutex);
+   snapshot = Book[book];
+   snapshot->ref_nb++;
+   my_mutex_unlock(BookMutex);
+
+   return snapshot;
+}
+
+// snapshot_release()
+
+static void snapshot_release(snapshot_t * snapshot) {
+
+   int ref_nb;
+
+   ASSERT(snapshot!=NULL);
+
+   my_mutex_lock(BookMutex);
+   ref_nb = --snapshot->ref_nb;
+   my_mutex_unlock(BookMutex);
+
+   ASSERT(ref_nb>=0);
+
+   if (ref_nb == 0) {
+      book_file_close(snapshot->book);
+      my_free(snapshot);
+   }
+}
+
+// book_reload()
+
+static int book_reload(int book, bool force) {
+
+   struct stat stat_1[1];
+   snapshot_t * snapshot;
+   snapshot_t * old;
+
+   ASSERT(book>=0&&book<BookNb);
+
+   // returns 1 if swapped, 0 if unchanged, -1 if the file can't be loaded
+
+   my_mutex_lock(ReloadMutex);
+
+   if (stat(BookName[book],stat_1) == -1) {
+      my_mutex_unlock(ReloadMutex);
+      return -1;
+   }
+
+   // unless forced, a changed file must look the same on two polls in a
+   // row; an atomic rename settles at once, an in-place write does not
+
+   if (!force) {
+
+      if (stat_equal(stat_1,Book[book]->stat) || !stat_equal(stat_1,&BookSeen[book])) {
+         BookSeen[book] = *stat_1;
+         my_mutex_unlock(ReloadMutex);
+         return 0;
+      }
+   }
+
+   BookSeen[book] = *stat_1;
+
+   // mapping and indexing happen here, off the probe path
+
+   snapshot = snapshot_open(BookName[book],stat_1);
+
+   if (snapshot == NULL) {
+      my_mutex_unlock(ReloadMutex);
+      return -1;
+   }
+
+   my_mutex_lock(BookMutex);
+   old = Book[book];
+   Book[book] = snapshot;
+   my_mutex_unlock(BookMutex);
+
+   my_mutex_unlock(ReloadMutex);
+
+   // in-flight probes keep the old snapshot alive until they are done
+
+   snapshot_release(old);
+
+   return 1;
+}
+
+// stat_equal()
+
+static bool stat_equal(const struct stat * stat_1, const struct stat * stat_2) {
+
+   ASSERT(stat_1!=NULL);
+   ASSERT(stat_2!=NULL);
+
+   return stat_1->st_dev == stat_2->st_dev
+       && stat_1->st_ino == stat_2->st_ino
+       && stat_1->st_size == stat_2->st_size
+       && stat_1->st_mtime == stat_2->st_mtime;
+}
+
+// watcher()
+
+static void watcher(void * arg) {
+
+   int elapsed;
+   int i;
+   bool stop;
+
+   (void) arg; // unused
+
+   elapsed = 0;
+
+   while (TRUE) {
+
+      my_sleep(WatchStep);
+      elapsed += WatchStep;
+
+      my_mutex_lock(ReloadMutex);
+      stop = WatchStop;
+      my_mutex_unlock(ReloadMutex);
+
+      if (stop) break;
+
+      if (elapsed >= WatchPeriod) {
+         for (i = 0; i < BookNb; i++) book_reload(i,FALSE);
+         elapsed = 0;
+      }
+   }
+}
+
+// queue_push()
+
+static void queue_push(job_list_t * batch) {
+
+   ASSERT(batch!=NULL);
+
+   if (batch->nb == 0) return;
+
+   my_mutex_lock(QueueMutex);
+
+   if (QueueTail != NULL) {
+      QueueTail->next = batch->head;
+   } else {
+      QueueHead = batch->head;
+   }
+
+   QueueTail = batch->tail;
+
+   if (batch->nb > 1) {
+      my_cond_broadcast(QueueCond);
+   } else {
+      my_cond_signal(QueueCond);
+   }
+
+   my_mutex_unlock(QueueMutex);
+
+   batch->head = NULL;
+   batch->tail = NULL;
+   batch->nb = 0;
+}
+
+// worker()
+
+static void worker(void * arg) {
+
+   job_t * batch[BatchSize];
+   int batch_nb;
+   int i;
+
+   (void) arg; // unused
+
+   while (TRUE) {
+
+      // take a batch, one lock round-trip for up to BatchSize requests
+
+      my_mutex_lock(QueueMutex);
+
+      while (QueueHead == NULL && !QueueStop) my_cond_wait(QueueCond,QueueMutex);
+
+      batch_nb = 0;
+
+      while (QueueHead != NULL && batch_nb < BatchSize) {
+         batch[batch_nb++] = QueueHead;
+         QueueHead = QueueHead->next;
+      }
+
+      if (QueueHead == NULL) QueueTail = NULL;
+
+      my_mutex_unlock(QueueMutex);
+
+      if (batch_nb == 0) break; // stopped and drained
+
+      for (i = 0; i < batch_nb; i++) job_answer(batch[i]);
+      for (i = 0; i < batch_nb; i++) job_complete(batch[i]);
+   }
+}
+
+// stats_add()
+
+static void stats_add(double latency) {
+
+   double micro;
+   int bucket;
+
+   micro = latency * 1E6;
+   if (micro < 0.0) micro = 0.0;
+
+   bucket = (int) (log(micro+1.0) / log(2.0) * 8.0);
+   if (bucket >= LatencyNb) bucket = LatencyNb - 1;
+
+   my_mutex_lock(StatsMutex);
+
+   StatsCount++;
+   StatsSum += micro;
+   if (micro > StatsMax) StatsMax = micro;
+   StatsLatency[bucket]++;
+
+   my_mutex_unlock(StatsMutex);
+}
+
+// stats_string()
+
+static void stats_string(char string[], int size) {
+
+   double quantile[2];
+   double value[2];
+   uint64 sum;
+   int bucket;
+   int q;
+
+   ASSERT(string!=NULL);
+
+   quantile[0] = 0.50;
+   quantile[1] = 0.99;
+
+   my_mutex_lock(StatsMutex);
+
+   // quantiles are bucket upper bounds, within 9% of the true value
+
+   for (q = 0; q < 2; q++) {
+
+      sum = 0;
+      value[q] = 0.0;
+
+      for (bucket = 0; bucket < LatencyNb && StatsCount != 0; bucket++) {
+         sum += StatsLatency[bucket];
+         if (sum >= quantile[q] * StatsCount) {
+            value[q] = pow(2.0,(bucket+1)/8.0) - 1.0;
+            if (value[q] > StatsMax) value[q] = StatsMax;
+            break;
+         }
+      }
+   }
+
+   snprintf(string,size,"stats requests %.0f mean %.1f p50 %.1f p99 %.1f max %.1f",
+            (double) StatsCount,
+            (StatsCount != 0) ? StatsSum / StatsCount : 0.0,
+            value[0],value[1],StatsMax);
+
+   my_mutex_unlock(StatsMutex);
+}
+
+// parse_key()
+
+static bool parse_key(const char string[], uint64 * key) {
+
+   int i;
+   int c;
+
+   ASSERT(string!=NULL);
+   ASSERT(key!=NULL);
+
+   if (string[0] == '0' && (string[1] == 'x' || string[1] == 'X')) string += 2;
+
+   *key = 0;
+
+   for (i = 0; (c = string[i]) != '\0'; i++) {
+
+      if (i >= 16) return FALSE;
+
+      if (c >= '0' && c <= '9') {
+         c -= '0';
+      } else if (c >= 'a' && c <= 'f') {
+         c -= 'a' - 10;
+      } else if (c >= 'A' && c <= 'F') {
+         c -= 'A' - 10;
+      } else {
+         return FALSE;
+      }
+
+      *key = (*key << 4) | c;
+   }
+
+   return i != 0;
+}
+
+#ifndef _WIN32
+
+// serve_socket()
+
+static void serve_socket(const char path[]) {
+
+   int server;
+   int * client;
+   struct sockaddr_un address;
+   my_thread_t thread;
+
+   ASSERT(path!=NULL);
+
+   if (strlen(path) >= sizeof(address.sun_path)) {
+      my_fatal("serve_socket(): socket path too long\n");
+   }
+
+   // a client hanging up must not kill the server
+
+   signal(SIGPIPE,SIG_IGN);
+
+   server = socket(AF_UNIX,SOCK_STREAM,0);
+   if (server == -1) my_fatal("serve_socket(): socket(): %s\n",strerror(errno));
+
+   memset(&address,0,sizeof(address));
+   address.sun_family = AF_UNIX;
+   strcpy(address.sun_path,path);
+
+   unlink(path);
+
+   if (bind(server,(struct sockaddr *)&address,sizeof(address)) == -1) {
+      my_fatal("serve_socket(): bind(): %s\n",strerror(errno));
+   }
+
+   if (listen(server,16) == -1) {
+      my_fatal("serve_socket(): listen(): %s\n",strerror(errno));
+   }
+
+   // one session thread per connection, all sharing the worker pool
+
+   while (TRUE) {
+
+      client = (int *) my_malloc(sizeof(int));
+
+      *client = accept(server,NULL,NULL);
+
+      if (*client == -1) {
+         my_free(client);
+         if (errno == EINTR) continue;
+         my_fatal("serve_socket(): accept(): %s\n",strerror(errno));
+      }
+
+      my_thread_create(&thread,socket_session,client);
+      my_thread_detach(&thread);
+   }
+}
+
+// socket_session()
+
+static void socket_session(void * arg) {
+
+   int client;
+   FILE * out;
+
+   ASSERT(arg!=NULL);
+
+   client = *((int *) arg);
+   my_free(arg);
+
+   out = fdopen(dup(client),"w");
+
+   if (out != NULL) {
+      session_run(client,out);
+      fclose(out);
+   }
+
+   close(client);
+}
+
+#endif
+
+// end of book_serve.c
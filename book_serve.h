@@ -0,0 +1,17 @@
+
+// book_serve.h
+
+#ifndef BOOK_SERVE_H
+#define BOOK_SERVE_H
+
+// includes
+
+#include "util.h"
+
+// functions
+
+extern void book_serve (int argc, char * argv[]);
+
+#endif // !defined BOOK_SERVE_H
+
+// end of book_serve.h
@@ -0,0 +1,359 @@
+
+// book_verify.c
+
+// includes
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "board.h"
+#include "book.h"
+#include "book_verify.h"
+#include "book_walk.h"
+#include "move.h"
+#include "move_legal.h"
+#include "option.h"
+#include "pgheader.h"
+#include "thread.h"
+#include "util.h"
+
+// constants
+
+#define ExampleMax 10
+#define LineSize   256
+
+// types
+
+enum error_t {
+   ERROR_HEADER,
+   ERROR_FORMAT,
+   ERROR_ORDER,
+   ERROR_SCORE,
+   ERROR_DUPLICATE,
+   ERROR_ILLEGAL,
+   ERROR_NB
+};
+
+typedef struct {
+   my_thread_t thread;
+   int first;
+   int last;
+   int error_nb[ERROR_NB];
+   int checked_nb;
+   int example_nb;
+   char example[ExampleMax][LineSize];
+} range_t;
+
+// variables
+
+static const char * ErrorName[ERROR_NB] = {
+   "header",
+   "format",
+   "key order",
+   "score order",
+   "duplicate move",
+   "illegal move",
+};
+
+static book_file_t Book[1];
+static book_walk_t Walk[1];
+
+// prototypes
+
+static void verify_range  (void * arg);
+static void range_error   (range_t * range, int error, int pos, const book_entry_t * entry);
+static int  key_boundary  (int pos);
+
+
+// functions
+
+// book_verify()
+
+void book_verify(int argc, char * argv[]) {
+
+   const char * bin_file;
+   int thread_nb;
+   range_t * range;
+   range_t header[1];
+   book_entry_t entry[1], prev[1];
+   book_cache_t cache[1];
+   book_entry_t entry_block[PackBlockSize];
+   struct stat file_stat[1];
+   char * string;
+   char * variants;
+   char * comment;
+   int error_nb[ERROR_NB];
+   int example_nb;
+   int total, checked_nb;
+   int ret;
+   int i, j;
+
+   bin_file = "book.bin";
+   thread_nb = my_cpu_nb();
+
+   for (i = 1; i < argc; i++) {
+
+      if (FALSE) {
+
+      } else if (my_string_equal(argv[i],"verify-book")) {
+
+         // skip
+
+      } else if (my_string_equal(argv[i],"-bin")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_verify(): missing argument\n");
+
+         bin_file = argv[i];
+
+      } else if (my_string_equal(argv[i],"-threads")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_verify(): missing argument\n");
+
+         thread_nb = atoi(argv[i]);
+         if (thread_nb < 1) my_fatal("book_verify(): bad thread number\n");
+
+      } else {
+
+         my_fatal("book_verify(): unknown option \"%s\"\n",argv[i]);
+      }
+   }
+
+   option_init_pg(); // book_file_open() reads the book options
+
+   if (!book_file_open(Book,bin_file)) {
+      my_fatal("book_verify(): can't open book \"%s\"\n",bin_file);
+      return;
+   }
+
+   if (Book->data == NULL) book_file_copy(Book);
+
+   // header: optional, but then well-formed and before any position
+
+   memset(header,0,sizeof(range_t));
+
+   ret = pgheader_read(&string,bin_file);
+
+   if (ret == PGHEADER_NO_ERROR) {
+      if (pgheader_parse(string,&variants,&comment) != PGHEADER_NO_ERROR) {
+         range_error(header,ERROR_HEADER,0,NULL);
+      } else {
+         free(variants);
+         free(comment);
+      }
+      free(string);
+   } else if (ret != PGHEADER_NO_HEADER) {
+      range_error(header,ERROR_HEADER,0,NULL);
+   }
+
+   // trailing bytes of a flat book are ignored by every reader
+
+   if (Book->pack->data == NULL && stat(bin_file,file_stat) == 0 && file_stat->st_size % 16 != 0) {
+      range_error(header,ERROR_FORMAT,Book->size,NULL);
+   }
+
+   // packed blocks that do not decode read as header entries below
+
+   if (Book->pack->data != NULL) {
+      for (i = 0; i < Book->pack->block_nb; i++) {
+         if (book_pack_block(Book->pack,i,entry_block) < 0) range_error(header,ERROR_FORMAT,i*PackBlockSize,NULL);
+      }
+   }
+
+   // positions reachable from the start get their moves checked
+
+   book_walk_build(Walk,Book);
+
+   // threads get ranges of whole positions
+
+   range = (range_t *) my_malloc(thread_nb*sizeof(range_t));
+   memset(range,0,thread_nb*sizeof(range_t));
+
+   for (i = 0; i < thread_nb; i++) {
+      range[i].first = key_boundary((int)(((sint64)Book->size * i) / thread_nb));
+      range[i].last = key_boundary((int)(((sint64)Book->size * (i+1)) / thread_nb));
+   }
+
+   for (i = 1; i < thread_nb; i++) my_thread_create(&range[i].thread,verify_range,&range[i]);
+   verify_range(&range[0]);
+   for (i = 1; i < thread_nb; i++) my_thread_join(&range[i].thread);
+
+   // order across range boundaries
+
+   for (i = 1; i < thread_nb; i++) {
+      if (range[i].first > 0 && range[i].first < range[i].last) {
+         book_cache_clear(cache);
+         book_cache_read(cache,Book,prev,range[i].first-1);
+         book_cache_read(cache,Book,entry,range[i].first);
+         if (entry->key < prev->key) range_error(header,ERROR_ORDER,range[i].first,entry);
+      }
+   }
+
+   // report, examples in book order
+
+   memcpy(error_nb,header->error_nb,sizeof(error_nb));
+   checked_nb = 0;
+
+   for (i = 0; i < thread_nb; i++) {
+      for (j = 0; j < ERROR_NB; j++) error_nb[j] += range[i].error_nb[j];
+      checked_nb += range[i].checked_nb;
+   }
+
+   example_nb = 0;
+
+   for (i = -1; i < thread_nb && example_nb < ExampleMax; i++) {
+      const range_t * r = (i < 0) ? header : &range[i];
+      for (j = 0; j < r->example_nb && example_nb < ExampleMax; j++) {
+         printf("%s\n",r->example[j]);
+         example_nb++;
+      }
+   }
+
+   total = 0;
+
+   for (j = 0; j < ERROR_NB; j++) {
+      printf("%-15s: %d error%s\n",ErrorName[j],error_nb[j],(error_nb[j]==1)?"":"s");
+      total += error_nb[j];
+   }
+
+   printf("%d entries, %d reachable positions, %d moves checked for legality\n",
+          Book->size,Walk->size,checked_nb);
+
+   my_free(range);
+   book_walk_free(Walk);
+   book_file_close(Book);
+
+   if (total != 0) {
+      printf("book \"%s\" is corrupt\n",bin_file);
+      exit(EXIT_FAILURE);
+   }
+
+   printf("book \"%s\" is ok\n",bin_file);
+}
+
+// verify_range()
+
+static void verify_range(void * arg) {
+
+   range_t * range;
+   book_entry_t entry[1], prev[1], other[1];
+   book_cache_t cache[1], other_cache[1];
+   board_t board[1];
+   bool started;
+   int group;
+   int node;
+   int pos, i;
+
+   range = (range_t *) arg;
+   ASSERT(range!=NULL);
+
+   started = FALSE;
+   group = range->first;
+   node = -1;
+
+   book_cache_clear(cache);
+   book_cache_clear(other_cache);
+
+   for (pos = range->first; pos < range->last; pos++) {
+
+      book_cache_read(cache,Book,entry,pos);
+
+      if (entry->key == U64(0x0)) {
+         if (pos > 0) { // header entries come first
+            book_cache_read(other_cache,Book,prev,pos-1);
+            if (prev->key != U64(0x0)) range_error(range,ERROR_HEADER,pos,entry);
+         }
+         continue;
+      }
+
+      if (!started || entry->key != prev->key) {
+
+         if (started && entry->key < prev->key) {
+            range_error(range,ERROR_ORDER,pos,entry);
+         }
+
+         group = pos;
+         node = book_walk_find(Walk,entry->key);
+         if (node >= 0) book_walk_board(Walk,node,board);
+
+      } else {
+
+         // moves of a position by decreasing weight
+
+         if (entry->count > prev->count) range_error(range,ERROR_SCORE,pos,entry);
+
+         for (i = group; i < pos; i++) {
+            book_cache_read(other_cache,Book,other,i);
+            if (other->move == entry->move) {
+               range_error(range,ERROR_DUPLICATE,pos,entry);
+               break;
+            }
+         }
+      }
+
+      if (node >= 0) {
+         range->checked_nb++;
+         if (entry->move == MoveNone || !move_is_legal(entry->move,board)) {
+            range_error(range,ERROR_ILLEGAL,pos,entry);
+         }
+      }
+
+      *prev = *entry;
+      started = TRUE;
+   }
+}
+
+// range_error()
+
+static void range_error(range_t * range, int error, int pos, const book_entry_t * entry) {
+
+   char move_string[16];
+
+   ASSERT(range!=NULL);
+   ASSERT(error>=0&&error<ERROR_NB);
+
+   range->error_nb[error]++;
+
+   if (range->example_nb == ExampleMax) return;
+
+   if (entry == NULL && pos == 0) {
+      snprintf(range->example[range->example_nb],LineSize,"%s error",ErrorName[error]);
+   } else if (entry == NULL) {
+      snprintf(range->example[range->example_nb],LineSize,"%s error at entry %d",ErrorName[error],pos);
+   } else {
+      move_to_coord(entry->move,move_string);
+      snprintf(range->example[range->example_nb],LineSize,"%s error at entry %d: key " U64_FORMAT " move %s weight %d",
+               ErrorName[error],pos,entry->key,move_string,entry->count);
+   }
+
+   range->example_nb++;
+}
+
+// key_boundary()
+
+static int key_boundary(int pos) {
+
+   book_entry_t entry[1], prev[1];
+   book_cache_t cache[1];
+
+   // first entry of the position holding entry pos
+
+   if (pos <= 0) return 0;
+   if (pos >= Book->size) return Book->size;
+
+   book_cache_clear(cache);
+   book_cache_read(cache,Book,prev,pos-1);
+
+   for (; pos < Book->size; pos++) {
+      book_cache_read(cache,Book,entry,pos);
+      if (entry->key != prev->key) break;
+   }
+
+   return pos;
+}
+
+// end of book_verify.c
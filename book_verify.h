@@ -0,0 +1,17 @@
+
+// book_verify.h
+
+#ifndef BOOK_VERIFY_H
+#define BOOK_VERIFY_H
+
+// includes
+
+#include "util.h"
+
+// functions
+
+extern void book_verify (int argc, char * argv[]);
+
+#endif // !defined BOOK_VERIFY_H
+
+// end of book_verify.h
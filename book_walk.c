@@ -0,0 +1,216 @@
+
+// book_walk.c
+
+// includes
+
+#include <string.h>
+
+#include "board.h"
+#include "book.h"
+#include "book_walk.h"
+#include "hash.h"
+#include "move.h"
+#include "move_do.h"
+#include "move_legal.h"
+#include "util.h"
+
+// constants
+
+#define EntryMax 256
+#define DepthMax 1024
+
+// prototypes
+
+static int  node_add  (book_walk_t * walk, uint64 key, int parent, int move);
+static void hash_grow (book_walk_t * walk);
+
+// functions
+
+// book_walk_clear()
+
+void book_walk_clear(book_walk_t * walk) {
+
+   ASSERT(walk!=NULL);
+
+   walk->size = 0;
+   walk->alloc = 0;
+   walk->node = NULL;
+   walk->mask = 0;
+   walk->hash = NULL;
+}
+
+// book_walk_build()
+
+void book_walk_build(book_walk_t * walk, const book_file_t * book) {
+
+   board_t * stack;
+   board_t board[1];
+   book_entry_t entry[EntryMax];
+   int stack_size, stack_alloc;
+   int entry_nb;
+   int node;
+   uint64 key;
+   int i;
+
+   ASSERT(walk!=NULL);
+   ASSERT(book!=NULL);
+
+   // every book position reachable from the start through book moves
+   // of either side, stored as its parent and the move from it.
+   // Nodes keep no board, book_walk_board() replays the path
+
+   book_walk_clear(walk);
+
+   walk->alloc = 1024;
+   walk->node = (book_walk_node_t *) my_malloc(walk->alloc*sizeof(book_walk_node_t));
+
+   walk->mask = 2047;
+   walk->hash = (sint32 *) my_malloc((walk->mask+1)*sizeof(sint32));
+   memset(walk->hash,-1,(walk->mask+1)*sizeof(sint32));
+
+   stack_alloc = 256;
+   stack = (board_t *) my_malloc(stack_alloc*sizeof(board_t));
+   stack_size = 0;
+
+   board_start(&stack[stack_size]);
+   if (book_file_find(book,stack[stack_size].key) < book->size) {
+      node_add(walk,stack[stack_size].key,-1,MoveNone);
+      stack_size++;
+   }
+
+   while (stack_size > 0) {
+
+      board_copy(board,&stack[--stack_size]);
+      node = book_walk_find(walk,board->key);
+      ASSERT(node>=0);
+
+      entry_nb = book_file_entries(book,board->key,entry,EntryMax);
+
+      for (i = 0; i < entry_nb; i++) {
+
+         if (entry[i].move == MoveNone || !move_is_legal(entry[i].move,board)) continue;
+
+         key = hash_move_key(board,entry[i].move);
+         if (book_walk_find(walk,key) >= 0) continue; // transposition
+         if (book_file_find(book,key) >= book->size) continue; // out of book
+
+         node_add(walk,key,node,entry[i].move);
+
+         if (stack_size == stack_alloc) {
+            stack_alloc *= 2;
+            stack = (board_t *) my_realloc(stack,stack_alloc*sizeof(board_t));
+         }
+
+         board_copy(&stack[stack_size],board);
+         move_do(&stack[stack_size],entry[i].move);
+         stack_size++;
+      }
+   }
+
+   my_free(stack);
+}
+
+// book_walk_free()
+
+void book_walk_free(book_walk_t * walk) {
+
+   ASSERT(walk!=NULL);
+
+   if (walk->node != NULL) my_free(walk->node);
+   if (walk->hash != NULL) my_free(walk->hash);
+
+   book_walk_clear(walk);
+}
+
+// book_walk_find()
+
+int book_walk_find(const book_walk_t * walk, uint64 key) {
+
+   uint32 index;
+   int node;
+
+   ASSERT(walk!=NULL);
+
+   if (walk->hash == NULL) return -1;
+
+   for (index = key & walk->mask; (node=walk->hash[index]) >= 0; index = (index+1) & walk->mask) {
+      if (walk->node[node].key == key) return node;
+   }
+
+   return -1;
+}
+
+// book_walk_board()
+
+void book_walk_board(const book_walk_t * walk, int node, board_t * board) {
+
+   uint16 move[DepthMax];
+   int depth;
+
+   ASSERT(walk!=NULL);
+   ASSERT(node>=0&&node<walk->size);
+   ASSERT(board!=NULL);
+
+   depth = 0;
+
+   for (; walk->node[node].parent >= 0; node = walk->node[node].parent) {
+      if (depth == DepthMax) my_fatal("book_walk_board(): line too long\n");
+      move[depth++] = walk->node[node].move;
+   }
+
+   board_start(board);
+
+   while (depth > 0) move_do(board,move[--depth]);
+}
+
+// node_add()
+
+static int node_add(book_walk_t * walk, uint64 key, int parent, int move) {
+
+   uint32 index;
+   int node;
+
+   ASSERT(walk!=NULL);
+
+   if (walk->size == walk->alloc) {
+      walk->alloc *= 2;
+      walk->node = (book_walk_node_t *) my_realloc(walk->node,walk->alloc*sizeof(book_walk_node_t));
+   }
+
+   node = walk->size++;
+
+   walk->node[node].key = key;
+   walk->node[node].parent = parent;
+   walk->node[node].move = move;
+
+   for (index = key & walk->mask; walk->hash[index] >= 0; index = (index+1) & walk->mask)
+      ;
+
+   walk->hash[index] = node;
+
+   if (2*(uint32)walk->size > walk->mask) hash_grow(walk);
+
+   return node;
+}
+
+// hash_grow()
+
+static void hash_grow(book_walk_t * walk) {
+
+   uint32 index;
+   int node;
+
+   ASSERT(walk!=NULL);
+
+   walk->mask = 2*walk->mask+1;
+   walk->hash = (sint32 *) my_realloc(walk->hash,(walk->mask+1)*sizeof(sint32));
+   memset(walk->hash,-1,(walk->mask+1)*sizeof(sint32));
+
+   for (node = 0; node < walk->size; node++) {
+      for (index = walk->node[node].key & walk->mask; walk->hash[index] >= 0; index = (index+1) & walk->mask)
+         ;
+      walk->hash[index] = node;
+   }
+}
+
+// end of book_walk.c
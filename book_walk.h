@@ -0,0 +1,40 @@
+
+// book_walk.h
+
+#ifndef BOOK_WALK_H
+#define BOOK_WALK_H
+
+// includes
+
+#include "board.h"
+#include "book.h"
+#include "util.h"
+
+// types
+
+typedef struct {
+   uint64 key;
+   sint32 parent;
+   uint16 move;
+} book_walk_node_t;
+
+typedef struct {
+   int size;
+   int alloc;
+   book_walk_node_t * node;
+   uint32 mask;
+   sint32 * hash;
+} book_walk_t;
+
+// functions
+
+extern void book_walk_clear (book_walk_t * walk);
+extern void book_walk_build (book_walk_t * walk, const book_file_t * book);
+extern void book_walk_free  (book_walk_t * walk);
+
+extern int  book_walk_find  (const book_walk_t * walk, uint64 key);
+extern void book_walk_board (const book_walk_t * walk, int node, board_t * board);
+
+#endif // !defined BOOK_WALK_H
+
+// end of book_walk.h
@@ -0,0 +1,132 @@
+
+// cms.c
+
+// count-min sketch with conservative update: a count is never
+// underestimated, so anything seen n times reads at least min(n,CmsCountMax)
+
+// includes
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cms.h"
+#include "hash.h"
+#include "util.h"
+
+// constants
+
+static const uint64 Seed[CmsDepth] = {
+   U64(0x9E3779B97F4A7C15), U64(0xC2B2AE3D27D4EB4F),
+   U64(0x165667B19E3779F9), U64(0xD6E8FEB86659FD93)
+};
+
+// prototypes
+
+static uint64 cms_hash (uint64 key, int row);
+
+// functions
+
+// cms_clear()
+
+void cms_clear(cms_t * cms) {
+
+   ASSERT(cms!=NULL);
+
+   cms->width = 0;
+   cms->counter = NULL;
+}
+
+// cms_free()
+
+void cms_free(cms_t * cms) {
+
+   ASSERT(cms!=NULL);
+
+   if (cms->counter != NULL) my_free(cms->counter);
+
+   cms_clear(cms);
+}
+
+// cms_init()
+
+void cms_init(cms_t * cms, double memory) {
+
+   ASSERT(cms!=NULL);
+   ASSERT(memory>0.0);
+
+   cms_free(cms);
+
+   cms->width = (uint32) (memory / CmsDepth);
+   if (cms->width == 0) cms->width = 1;
+
+   cms->counter = (uint8 *) my_malloc(((size_t)cms->width)*CmsDepth);
+   memset(cms->counter,0,((size_t)cms->width)*CmsDepth);
+}
+
+// cms_add()
+
+void cms_add(cms_t * cms, uint64 key) {
+
+   uint8 * counter[CmsDepth];
+   int min;
+   int row;
+
+   ASSERT(cms!=NULL);
+   ASSERT(cms->width>0);
+
+   min = CmsCountMax;
+
+   for (row = 0; row < CmsDepth; row++) {
+      counter[row] = &cms->counter[((size_t)row)*cms->width+REDUCE(cms_hash(key,row),cms->width)];
+      if (*counter[row] < min) min = *counter[row];
+   }
+
+   if (min == CmsCountMax) return;
+
+   // only the smallest counters grow, the others already cover this key
+
+   for (row = 0; row < CmsDepth; row++) {
+      if (*counter[row] == min) (*counter[row])++;
+   }
+}
+
+// cms_count()
+
+int cms_count(const cms_t * cms, uint64 key) {
+
+   int min;
+   int row;
+   int n;
+
+   ASSERT(cms!=NULL);
+   ASSERT(cms->width>0);
+
+   min = CmsCountMax;
+
+   for (row = 0; row < CmsDepth; row++) {
+      n = cms->counter[((size_t)row)*cms->width+REDUCE(cms_hash(key,row),cms->width)];
+      if (n < min) min = n;
+   }
+
+   return min;
+}
+
+// cms_memory()
+
+double cms_memory(const cms_t * cms) {
+
+   ASSERT(cms!=NULL);
+
+   return ((double)cms->width) * CmsDepth;
+}
+
+// cms_hash()
+
+static uint64 cms_hash(uint64 key, int row) {
+
+   ASSERT(row>=0&&row<CmsDepth);
+
+   return hash_mix_64(key^Seed[row]);
+}
+
+// end of cms.c
@@ -0,0 +1,37 @@
+
+// cms.h
+
+#ifndef CMS_H
+#define CMS_H
+
+// includes
+
+#include "util.h"
+
+// defines
+
+#define CmsDepth 4
+#define CmsCountMax 255 // counters saturate here
+
+// types
+
+typedef struct {
+   uint32 width;
+   uint8 * counter; // CmsDepth rows, saturating at CmsCountMax
+} cms_t;
+
+// functions
+
+extern void   cms_clear  (cms_t * cms);
+extern void   cms_free   (cms_t * cms);
+
+extern void   cms_init   (cms_t * cms, double memory);
+
+extern void   cms_add    (cms_t * cms, uint64 key);
+extern int    cms_count  (const cms_t * cms, uint64 key);
+
+extern double cms_memory (const cms_t * cms);
+
+#endif // !defined CMS_H
+
+// end of cms.h
@@ -6,6 +6,7 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "board.h"
 #include "colour.h"
@@ -388,5 +389,108 @@ bool board_to_fen(const board_t * board, char string[], int size) {
    return TRUE;
 }
 
+// fen_is_ok()
+
+bool fen_is_ok(const char string[]) {
+
+   int pos;
+   int file, rank;
+   int c;
+   int piece;
+   int piece_nb[ColourNb], pawn_nb[ColourNb], king_nb[ColourNb];
+
+   ASSERT(string!=NULL);
+
+   // checks what board_from_fen() would reject with my_fatal(),
+   // for callers that must survive bad input
+
+   piece_nb[White] = piece_nb[Black] = 0;
+   pawn_nb[White] = pawn_nb[Black] = 0;
+   king_nb[White] = king_nb[Black] = 0;
+
+   pos = 0;
+   c = string[pos];
+
+   // piece placement
+
+   for (rank = 7; rank >= 0; rank--) {
+
+      for (file = 0; file < 8;) {
+
+         if (c >= '1' && c <= '8') { // empty square(s)
+
+            file += c - '0';
+            if (file > 8) return FALSE;
+
+         } else { // piece
+
+            piece = piece_from_char(c);
+            if (piece == PieceNone256) return FALSE;
+
+            if (piece_is_pawn(piece)) {
+               if (rank == 0 || rank == 7) return FALSE;
+               pawn_nb[piece_colour(piece)]++;
+            } else if (piece_is_king(piece)) {
+               king_nb[piece_colour(piece)]++;
+            }
+
+            piece_nb[piece_colour(piece)]++;
+            file++;
+         }
+
+         c = string[++pos];
+      }
+
+      if (rank > 0) {
+         if (c != '/') return FALSE;
+         c = string[++pos];
+      }
+   }
+
+   if (king_nb[White] != 1 || king_nb[Black] != 1) return FALSE;
+   if (pawn_nb[White] > 8 || pawn_nb[Black] > 8) return FALSE;
+   if (piece_nb[White] > 16 || piece_nb[Black] > 16) return FALSE;
+
+   // active colour
+
+   if (c != ' ' && c != '\t') return FALSE;
+   while (c == ' ' || c == '\t') c = string[++pos];
+
+   if (c != 'w' && c != 'b') return FALSE;
+   c = string[++pos];
+
+   // castling
+
+   if (c != ' ' && c != '\t') return FALSE;
+   while (c == ' ' || c == '\t') c = string[++pos];
+
+   if (c == '-') {
+
+      c = string[++pos];
+
+   } else {
+
+      do {
+         if (strchr("KQkqABCDEFGHabcdefgh",c) == NULL || c == '\0') return FALSE;
+         c = string[++pos];
+      } while (c != ' ');
+   }
+
+   // en-passant
+
+   if (c != ' ' && c != '\t') return FALSE;
+   while (c == ' ' || c == '\t') c = string[++pos];
+
+   if (c != '-') {
+      if (c < 'a' || c > 'h') return FALSE;
+      c = string[++pos];
+      if (c < '1' || c > '8') return FALSE;
+   }
+
+   // the move counters are optional
+
+   return TRUE;
+}
+
 // end of fen.cpp
 
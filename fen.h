@@ -18,6 +18,8 @@ extern const char * StartFen;
 extern bool board_from_fen (board_t * board, const char string[]);
 extern bool board_to_fen   (const board_t * board, char string[], int size);
 
+extern bool fen_is_ok      (const char string[]);
+
 #endif // !defined FEN_H
 
 // end of fen.h
@@ -3,8 +3,12 @@
 
 // includes
 
+#include <stdlib.h>
+
 #include "board.h"
+#include "colour.h"
 #include "hash.h"
+#include "move.h"
 #include "piece.h"
 #include "random.h"
 #include "square.h"
@@ -69,6 +73,119 @@ uint64 hash_key(const board_t * board) {
    return key;
 }
 
+// hash_move_key()
+
+uint64 hash_move_key(const board_t * board, int move) {
+
+   uint64 key;
+   int me, opp;
+   int from, to;
+   int piece, capture, pawn;
+   int castle[ColourNb][SideNb];
+   int old_flags, new_flags;
+   int rank, king_to, rook_to;
+   int sq;
+
+   ASSERT(board_is_ok(board));
+   ASSERT(move_is_ok(move));
+
+   // the key of the position after move, as move_do() would leave it
+
+   me = board->turn;
+   opp = colour_opp(me);
+
+   from = move_from(move);
+   to = move_to(move);
+
+   piece = board->square[from];
+   ASSERT(colour_equal(piece,me));
+
+   key = board->key;
+
+   // turn
+
+   key ^= hash_turn_key(White);
+
+   // castling rights
+
+   old_flags = board_flags(board);
+
+   castle[White][SideH] = board->castle[White][SideH];
+   castle[White][SideA] = board->castle[White][SideA];
+   castle[Black][SideH] = board->castle[Black][SideH];
+   castle[Black][SideA] = board->castle[Black][SideA];
+
+   if (piece_is_king(piece)) {
+      castle[me][SideH] = SquareNone;
+      castle[me][SideA] = SquareNone;
+   }
+
+   if (castle[me][SideH] == from) castle[me][SideH] = SquareNone;
+   if (castle[me][SideA] == from) castle[me][SideA] = SquareNone;
+
+   if (castle[opp][SideH] == to) castle[opp][SideH] = SquareNone;
+   if (castle[opp][SideA] == to) castle[opp][SideA] = SquareNone;
+
+   new_flags = 0;
+   if (castle[White][SideH] != SquareNone) new_flags |= 1 << 0;
+   if (castle[White][SideA] != SquareNone) new_flags |= 1 << 1;
+   if (castle[Black][SideH] != SquareNone) new_flags |= 1 << 2;
+   if (castle[Black][SideA] != SquareNone) new_flags |= 1 << 3;
+
+   key ^= hash_castle_key(new_flags^old_flags);
+
+   // en-passant square, only set if an enemy pawn could take
+
+   if (board->ep_square != SquareNone) key ^= hash_ep_key(board->ep_square);
+
+   if (piece_is_pawn(piece) && abs(to-from) == 32) {
+      pawn = piece_make_pawn(opp);
+      if (board->square[to-1] == pawn || board->square[to+1] == pawn) {
+         key ^= hash_ep_key((from+to)/2);
+      }
+   }
+
+   // castle (king takes own rook)
+
+   if (colour_equal(board->square[to],me)) {
+
+      rank = colour_is_white(me) ? Rank1 : Rank8;
+
+      if (to > from) { // h side
+         king_to = square_make(FileG,rank);
+         rook_to = square_make(FileF,rank);
+      } else { // a side
+         king_to = square_make(FileC,rank);
+         rook_to = square_make(FileD,rank);
+      }
+
+      key ^= hash_piece_key(piece,from) ^ hash_piece_key(piece,king_to);
+      key ^= hash_piece_key(board->square[to],to) ^ hash_piece_key(board->square[to],rook_to);
+
+      return key;
+   }
+
+   // captured piece
+
+   if (piece_is_pawn(piece) && to == board->ep_square) {
+      sq = square_ep_dual(to);
+      key ^= hash_piece_key(board->square[sq],sq);
+   } else {
+      capture = board->square[to];
+      if (capture != Empty) key ^= hash_piece_key(capture,to);
+   }
+
+   // moving piece
+
+   key ^= hash_piece_key(piece,from);
+
+   if (move_is_promote(move)) piece = move_promote_hack(move) | me; // HACK
+
+   key ^= hash_piece_key(piece,to);
+
+   return key;
+}
+
 // hash_piece_key()
 
 uint64 hash_piece_key(int piece, int square) {
@@ -124,5 +241,32 @@ uint64 hash_turn_key(int colour) {
    return (colour_is_white(colour)) ? random_64(RandomTurn) : 0;
 }
 
+// hash_mix_64()
+
+uint64 hash_mix_64(uint64 key) {
+
+   // splitmix64 finaliser, for tables that do not trust book keys (or
+   // keys combined from them) to be random in every bit
+
+   key ^= key >> 30;
+   key *= U64(0xBF58476D1CE4E5B9);
+   key ^= key >> 27;
+   key *= U64(0x94D049BB133111EB);
+   key ^= key >> 31;
+
+   return key;
+}
+
+// hash_pair_key()
+
+uint64 hash_pair_key(uint64 key, int move) {
+
+   ASSERT(move>=0&&move<65536);
+
+   // one key per (position, move), for the counters of book entries
+
+   return key ^ (U64(0x9E3779B97F4A7C15) * (move+1));
+}
+
 // end of hash.cpp
 
@@ -20,11 +20,18 @@
 #define  RandomTurn        780
 // 1
 
+// macros
+
+// maps a 64-bit hash to [0,n) with its high bits, n need not be a power of two
+
+#define REDUCE(x,n) ((uint32)((((x)>>32)*((uint64)(n)))>>32))
+
 // functions
 
 extern void   hash_init       ();
 
 extern uint64 hash_key        (const board_t * board);
+extern uint64 hash_move_key   (const board_t * board, int move);
 
 extern uint64 hash_piece_key  (int piece, int square);
 extern uint64 hash_castle_key (int flags);
@@ -33,6 +40,9 @@ extern uint64 hash_turn_key   (int colour);
 
 extern uint64 hash_random_64  (int index);
 
+extern uint64 hash_mix_64     (uint64 key);
+extern uint64 hash_pair_key   (uint64 key, int move);
+
 #endif // !defined HASH_H
 
 // end of hash.h
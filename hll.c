@@ -0,0 +1,111 @@
+
+// hll.c
+
+// HyperLogLog distinct counter (Flajolet et al., with the linear counting
+// correction for small cardinalities)
+
+// includes
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "hll.h"
+#include "util.h"
+
+// functions
+
+// hll_clear()
+
+void hll_clear(hll_t * hll) {
+
+   ASSERT(hll!=NULL);
+
+   hll->bits = 0;
+   hll->size = 0;
+   hll->reg = NULL;
+}
+
+// hll_free()
+
+void hll_free(hll_t * hll) {
+
+   ASSERT(hll!=NULL);
+
+   if (hll->reg != NULL) my_free(hll->reg);
+
+   hll_clear(hll);
+}
+
+// hll_init()
+
+void hll_init(hll_t * hll, int bits) {
+
+   ASSERT(hll!=NULL);
+   ASSERT(bits>=4&&bits<=20);
+
+   hll_free(hll);
+
+   hll->bits = bits;
+   hll->size = 1 << bits;
+   hll->reg = (uint8 *) my_malloc(hll->size);
+
+   memset(hll->reg,0,hll->size);
+}
+
+// hll_add()
+
+void hll_add(hll_t * hll, uint64 key) {
+
+   uint64 hash;
+   uint64 rest;
+   int index;
+   int rank;
+
+   ASSERT(hll!=NULL);
+   ASSERT(hll->reg!=NULL);
+
+   hash = hash_mix_64(key);
+
+   // the top bits pick the register, the rest gives the rank of the first one
+
+   index = (int) (hash >> (64 - hll->bits));
+   rest = hash << hll->bits;
+
+   for (rank = 1; rank <= 64 - hll->bits && (rest & (U64(1) << 63)) == 0; rank++) rest <<= 1;
+
+   if (rank > hll->reg[index]) hll->reg[index] = rank;
+}
+
+// hll_count()
+
+double hll_count(const hll_t * hll) {
+
+   double m;
+   double sum;
+   double estimate;
+   int zero;
+   int i;
+
+   ASSERT(hll!=NULL);
+   ASSERT(hll->reg!=NULL);
+
+   m = hll->size;
+
+   sum = 0.0;
+   zero = 0;
+
+   for (i = 0; i < hll->size; i++) {
+      sum += ldexp(1.0,-hll->reg[i]);
+      if (hll->reg[i] == 0) zero++;
+   }
+
+   estimate = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+
+   if (estimate <= 2.5 * m && zero != 0) estimate = m * log(m / zero);
+
+   return estimate;
+}
+
+// end of hll.c
@@ -0,0 +1,35 @@
+
+// hll.h
+
+#ifndef HLL_H
+#define HLL_H
+
+// includes
+
+#include "util.h"
+
+// defines
+
+#define HllBits 14 // 16384 registers, about 0.8% standard error
+
+// types
+
+typedef struct {
+   int bits;
+   int size;
+   uint8 * reg;
+} hll_t;
+
+// functions
+
+extern void   hll_clear (hll_t * hll);
+extern void   hll_free  (hll_t * hll);
+
+extern void   hll_init  (hll_t * hll, int bits);
+
+extern void   hll_add   (hll_t * hll, uint64 key);
+extern double hll_count (const hll_t * hll);
+
+#endif // !defined HLL_H
+
+// end of hll.h
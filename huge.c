@@ -0,0 +1,272 @@
+
+// huge.c
+
+// large tables backed by huge pages, so that random probes miss the TLB less:
+// explicit hugetlbfs pages if some are reserved, else aligned anonymous
+// memory advised for transparent huge pages, else malloc()
+
+// includes
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "huge.h"
+#include "thread.h"
+#include "util.h"
+
+// constants
+
+#define HeaderSize 64 // keeps the caller's data on a cache line boundary
+
+#define SmallPageSize 4 // kB
+
+// types
+
+enum { Small, HugeTlb, Madvise };
+
+typedef struct {
+   void * base;
+   size_t size;
+   size_t map_size;
+   int method;
+} header_t;
+
+// variables
+
+static int PageSize = -1; // bytes
+
+static volatile int HugeTlbKb;
+static volatile int MadviseKb;
+static volatile int SmallKb;
+
+// prototypes
+
+static int    page_size    ();
+static int    meminfo_kb   (const char file_name[], const char field[]);
+
+static void * block_init   (void * base, size_t size, size_t map_size, int method);
+static void   block_count  (const header_t * header, int sign);
+
+// functions
+
+// huge_malloc()
+
+void * huge_malloc(size_t size) {
+
+   size_t page;
+   size_t map_size;
+   char * base;
+#if defined(__linux__)
+   char * raw;
+   size_t skip;
+#endif
+
+   ASSERT(size>0);
+
+   page = page_size();
+
+   // less than a huge page gains nothing
+
+   if (page != 0 && size + HeaderSize >= page) {
+
+      map_size = (size + HeaderSize + page - 1) / page * page;
+
+#if defined(__linux__) && defined(MAP_HUGETLB)
+      base = (char *) mmap(NULL,map_size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+      if (base != MAP_FAILED) return block_init(base,size,map_size,HugeTlb);
+#endif
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+
+      // one extra page to align the block, the ends are given back
+
+      raw = (char *) mmap(NULL,map_size+page,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+
+      if (raw != MAP_FAILED) {
+
+         skip = (page - ((size_t) raw) % page) % page;
+         base = raw + skip;
+
+         if (skip != 0) munmap(raw,skip);
+         if (page - skip != 0) munmap(base+map_size,page-skip);
+
+         madvise(base,map_size,MADV_HUGEPAGE);
+
+         return block_init(base,size,map_size,Madvise);
+      }
+#endif
+   }
+
+   base = (char *) my_malloc(size+HeaderSize);
+
+   return block_init(base,size,size+HeaderSize,Small);
+}
+
+// huge_realloc()
+
+void * huge_realloc(void * address, size_t size) {
+
+   header_t * header;
+   void * new_address;
+
+   ASSERT(address!=NULL);
+   ASSERT(size>0);
+
+   header = (header_t *) ((char *) address - HeaderSize);
+
+   // mappings are rounded up to whole pages, which may already be enough
+
+   if (header->method != Small && size + HeaderSize <= header->map_size) {
+      header->size = size;
+      return address;
+   }
+
+   if (header->method == Small && (page_size() == 0 || size + HeaderSize < (size_t) page_size())) {
+      block_count(header,-1);
+      return block_init(my_realloc(header->base,size+HeaderSize),size,size+HeaderSize,Small);
+   }
+
+   new_address = huge_malloc(size);
+   memcpy(new_address,address,(header->size<size)?header->size:size);
+   huge_free(address);
+
+   return new_address;
+}
+
+// huge_free()
+
+void huge_free(void * address) {
+
+   header_t * header;
+
+   ASSERT(address!=NULL);
+
+   header = (header_t *) ((char *) address - HeaderSize);
+
+   block_count(header,-1);
+
+#if defined(__linux__)
+   if (header->method != Small) {
+      munmap(header->base,header->map_size);
+      return;
+   }
+#endif
+
+   my_free(header->base);
+}
+
+// huge_stats()
+
+void huge_stats(huge_stats_t * stats) {
+
+   int huge_kb;
+   int anon_kb;
+
+   ASSERT(stats!=NULL);
+
+   stats->page_size = page_size() / 1024;
+   stats->hugetlb_kb = HugeTlbKb;
+   stats->madvise_kb = MadviseKb;
+   stats->small_kb = SmallKb;
+
+   // the kernel decides which advised pages it backs, and only says so
+   // for the whole process
+
+   anon_kb = meminfo_kb("/proc/self/smaps_rollup","AnonHugePages:");
+   stats->backed_kb = (anon_kb < 0) ? -1 : (anon_kb < MadviseKb) ? anon_kb : MadviseKb;
+
+   huge_kb = HugeTlbKb + ((stats->backed_kb > 0) ? stats->backed_kb : 0);
+
+   stats->tlb_nb = (stats->page_size != 0) ? huge_kb / stats->page_size : 0;
+   stats->tlb_nb += (HugeTlbKb + MadviseKb + SmallKb - huge_kb) / SmallPageSize;
+}
+
+// page_size()
+
+static int page_size() {
+
+   int kb;
+
+   if (PageSize < 0) {
+      kb = meminfo_kb("/proc/meminfo","Hugepagesize:");
+      PageSize = (kb > 0) ? kb * 1024 : 0;
+   }
+
+   return PageSize;
+}
+
+// meminfo_kb()
+
+static int meminfo_kb(const char file_name[], const char field[]) {
+
+   FILE * file;
+   char line[256];
+   int kb;
+
+   ASSERT(file_name!=NULL);
+   ASSERT(field!=NULL);
+
+   file = fopen(file_name,"r");
+   if (file == NULL) return -1;
+
+   kb = -1;
+
+   while (fgets(line,sizeof(line),file) != NULL) {
+      if (strncmp(line,field,strlen(field)) == 0) {
+         kb = atoi(line+strlen(field));
+         break;
+      }
+   }
+
+   fclose(file);
+
+   return kb;
+}
+
+// block_init()
+
+static void * block_init(void * base, size_t size, size_t map_size, int method) {
+
+   header_t * header;
+
+   ASSERT(base!=NULL);
+
+   header = (header_t *) base;
+
+   header->base = base;
+   header->size = size;
+   header->map_size = map_size;
+   header->method = method;
+
+   block_count(header,+1);
+
+   return (char *) base + HeaderSize;
+}
+
+// block_count()
+
+static void block_count(const header_t * header, int sign) {
+
+   int kb;
+
+   ASSERT(header!=NULL);
+   ASSERT(sign==+1||sign==-1);
+
+   kb = (int) (header->map_size / 1024) * sign;
+
+   if (FALSE) {
+   } else if (header->method == HugeTlb) {
+      my_atomic_add(&HugeTlbKb,kb);
+   } else if (header->method == Madvise) {
+      my_atomic_add(&MadviseKb,kb);
+   } else {
+      my_atomic_add(&SmallKb,kb);
+   }
+}
+
+// end of huge.c
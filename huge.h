@@ -0,0 +1,32 @@
+
+// huge.h
+
+#ifndef HUGE_H
+#define HUGE_H
+
+// includes
+
+#include "util.h"
+
+// types
+
+typedef struct {
+   int page_size;  // huge page size in kB, 0 if unavailable
+   int hugetlb_kb; // explicit huge pages
+   int madvise_kb; // transparent huge page candidates
+   int small_kb;   // ordinary pages
+   int backed_kb;  // transparent huge pages in use, -1 if unknown
+   int tlb_nb;     // page translations covering all of the above
+} huge_stats_t;
+
+// functions
+
+extern void * huge_malloc  (size_t size);
+extern void * huge_realloc (void * address, size_t size);
+extern void   huge_free    (void * address);
+
+extern void   huge_stats   (huge_stats_t * stats);
+
+#endif // !defined HUGE_H
+
+// end of huge.h
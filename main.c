@@ -4,8 +4,15 @@
 
 #include "board.h"
 #include "book.h"
+#include "book_diff.h"
+#include "book_estimate.h"
+#include "book_export.h"
 #include "book_make.h"
 #include "book_merge.h"
+#include "book_pack.h"
+#include "book_mph.h"
+#include "book_serve.h"
+#include "book_verify.h"
 #include "fen.h"
 #include "hash.h"
 #include "list.h"
@@ -41,6 +48,38 @@ int main(int argc, char * argv[])
 	{
         book_info(argc, argv);
     }
+    else if (argc >= 2 && !strcmp(argv[1], "build-index"))
+	{
+        book_build_index(argc, argv);
+    }
+    else if (argc >= 2 && !strcmp(argv[1], "serve-book"))
+	{
+        book_serve(argc, argv);
+    }
+    else if (argc >= 2 && !strcmp(argv[1], "export-book"))
+	{
+        book_export(argc, argv);
+    }
+    else if (argc >= 2 && !strcmp(argv[1], "diff-book"))
+	{
+        book_diff(argc, argv);
+    }
+    else if (argc >= 2 && !strcmp(argv[1], "verify-book"))
+	{
+        book_verify(argc, argv);
+    }
+    else if (argc >= 2 && !strcmp(argv[1], "pack-book"))
+	{
+        book_pack(argc, argv);
+    }
+    else if (argc >= 2 && !strcmp(argv[1], "unpack-book"))
+	{
+        book_unpack(argc, argv);
+    }
+    else if (argc >= 2 && !strcmp(argv[1], "estimate-book"))
+	{
+        book_estimate(argc, argv);
+    }
 
     return 0;
 }
\ No newline at end of file
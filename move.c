@@ -190,15 +190,36 @@ int move_promote(int move, const board_t * board) {
 bool move_is_check(int move, const board_t * board) {
 
    board_t new_board[1];
+   int from, to, piece, king;
 
    ASSERT(move_is_ok(move));
    ASSERT(board_is_ok(board));
 
-   board_copy(new_board,board);
-   move_do(new_board,move);
-   ASSERT(!is_in_check(new_board,colour_opp(new_board->turn)));
+   // special moves
+
+   if (move_is_castle(move,board) || move_is_en_passant(move,board) || move_is_promote(move)) {
+
+      board_copy(new_board,board);
+      move_do(new_board,move);
+      ASSERT(!is_in_check(new_board,colour_opp(new_board->turn)));
+
+      return board_is_check(new_board);
+   }
+
+   // without playing the move
+
+   from = move_from(move);
+   to = move_to(move);
+   piece = board->square[from];
+   king = king_pos(board,colour_opp(board->turn));
+
+   // direct check
+
+   if (!piece_is_king(piece) && piece_attack(board,piece,to,king)) return TRUE;
+
+   // discovered check
 
-   return board_is_check(new_board);
+   return is_pinned(board,from,to,colour_opp(board->turn));
 }
 
 // move_is_mate()
@@ -210,6 +231,8 @@ bool move_is_mate(int move, const board_t * board) {
    ASSERT(move_is_ok(move));
    ASSERT(board_is_ok(board));
 
+   if (!move_is_check(move,board)) return FALSE;
+
    board_copy(new_board,board);
    move_do(new_board,move);
    ASSERT(!is_in_check(new_board,colour_opp(new_board->turn)));
@@ -272,6 +295,30 @@ bool move_to_can(int move, const board_t * board, char string[], int size) {
    return TRUE;
 }
 
+// move_to_coord()
+
+void move_to_coord(int move, char string[]) {
+
+   int promote;
+
+   ASSERT(string!=NULL);
+
+   // the raw book encoding, without a board: castling stays king takes
+   // rook, as stored in Polyglot books
+
+   if (!square_to_string(square_from_64((move>>6)&077),&string[0],3)
+    || !square_to_string(square_from_64(move&077),&string[2],3)) {
+      my_fatal("move_to_coord(): bad move %d\n",move);
+   }
+
+   promote = (move >> 12) & 7;
+
+   if (promote >= 1 && promote <= 4) {
+      string[4] = "nbrq"[promote-1];
+      string[5] = '\0';
+   }
+}
+
 // move_from_can()
 
 int move_from_can(const char string[], const board_t * board) {
@@ -51,6 +51,7 @@ extern int  move_order          (int move);
 
 extern bool move_to_can         (int move, const board_t * board, char string[], int size);
 extern int  move_from_can       (const char string[], const board_t * board);
+extern void move_to_coord       (int move, char string[]);
 
 extern void move_disp           (int move, const board_t * board);
 
@@ -57,6 +57,9 @@ option_t DefaultOptions[] = {
     { "BookDepth",        "spin","0","256",     "256"       , NULL,0,NNB,  PG|XBOARD|XBSEL|UCI}, 
     { "BookTreshold",     "spin","0","1000",    "5"         , NULL,0,NNB,  PG|XBOARD|UCI}, 
     { "BookLearn",        "check","0","0",      "false"     , NULL,0,NNB,  PG|XBOARD}, 
+    { "BookIndex",        "check","0","0",      "false"     , NULL,0,NNB,  PG}, 
+    { "BookIndexSave",    "check","0","0",      "false"     , NULL,0,NNB,  PG}, 
+    { "BookFilter",       "check","0","0",      "false"     , NULL,0,NNB,  PG}, 
 
     { "KibitzMove",       "check","0","0",      "false"     , NULL,0,NNB,  PG|XBOARD}, 
     { "KibitzPV",         "check","0","0",      "false"     , NULL,0,NNB,  PG|XBOARD}, 
@@ -13,6 +13,8 @@
 
 // constants
 
+#define PGN_BUFFER_SIZE (1<<16)
+
 static const bool DispMove = FALSE;
 static const bool DispToken = FALSE;
 static const bool DispChar = FALSE;
@@ -57,8 +59,14 @@ void pgn_open(pgn_t * pgn, const char file_name[]) {
    ASSERT(pgn!=NULL);
    ASSERT(file_name!=NULL);
 
-   pgn->file = fopen(file_name,"r");
-   if (pgn->file == NULL) my_fatal("pgn_open(): can't open file \"%s\": %s\n",file_name,strerror(errno));
+   // compressed files are read through their decompressor
+
+   pgn->stream = (stream_t *) my_malloc(sizeof(stream_t));
+   if (!stream_open(pgn->stream,file_name)) my_fatal("pgn_open(): can't open file \"%s\": %s\n",file_name,strerror(errno));
+
+   pgn->buffer = (const char *) my_malloc(PGN_BUFFER_SIZE);
+   pgn->buffer_size = 0;
+   pgn->buffer_pos = 0;
 
    pgn->char_hack = CHAR_EOF; // DEBUG
    pgn->char_line = 1;
@@ -81,13 +89,54 @@ void pgn_open(pgn_t * pgn, const char file_name[]) {
    pgn->move_column = -1; // DEBUG
 }
 
+// pgn_open_buffer()
+
+void pgn_open_buffer(pgn_t * pgn, const char buffer[], int size, int line) {
+
+   ASSERT(pgn!=NULL);
+   ASSERT(buffer!=NULL);
+   ASSERT(size>=0);
+
+   // games already in memory, line numbers continue those of the file
+
+   pgn->stream = NULL;
+
+   pgn->buffer = buffer;
+   pgn->buffer_size = size;
+   pgn->buffer_pos = 0;
+
+   pgn->char_hack = CHAR_EOF; // DEBUG
+   pgn->char_line = line;
+   pgn->char_column = 0;
+   pgn->char_unread = FALSE;
+   pgn->char_first = TRUE;
+
+   pgn->token_type = TOKEN_ERROR; // DEBUG
+   strcpy(pgn->token_string,"?"); // DEBUG
+   pgn->token_length = -1; // DEBUG
+   pgn->token_line = -1; // DEBUG
+   pgn->token_column = -1; // DEBUG
+   pgn->token_unread = FALSE;
+   pgn->token_first = TRUE;
+
+   strcpy(pgn->result,"?"); // DEBUG
+   strcpy(pgn->fen,"?"); // DEBUG
+
+   pgn->move_line = -1; // DEBUG
+   pgn->move_column = -1; // DEBUG
+}
+
 // pgn_close()
 
 void pgn_close(pgn_t * pgn) {
 
    ASSERT(pgn!=NULL);
 
-   fclose(pgn->file);
+   if (pgn->stream != NULL) {
+      stream_close(pgn->stream);
+      my_free(pgn->stream);
+      my_free((void *) pgn->buffer);
+   }
 }
 
 // pgn_next_game()
@@ -615,10 +664,14 @@ static void pgn_char_read(pgn_t * pgn) {
 
    // read a new character
 
-   pgn->char_hack = fgetc(pgn->file);
+   if (pgn->buffer_pos == pgn->buffer_size && pgn->stream != NULL) {
+      pgn->buffer_size = stream_read(pgn->stream,(char *) pgn->buffer,PGN_BUFFER_SIZE);
+      pgn->buffer_pos = 0;
+   }
 
-   if (pgn->char_hack == EOF) {
-      if (ferror(pgn->file)) my_fatal("pgn_char_read(): fgetc(): %s\n",strerror(errno));
+   if (pgn->buffer_pos < pgn->buffer_size) {
+      pgn->char_hack = (uint8) pgn->buffer[pgn->buffer_pos++];
+   } else {
       pgn->char_hack = CHAR_EOF;
    }
 
@@ -8,6 +8,7 @@
 
 #include <stdio.h>
 
+#include "stream.h"
 #include "util.h"
 
 // defines
@@ -18,7 +19,11 @@
 
 typedef struct {
 
-   FILE * file;
+   stream_t * stream; // refills buffer, NULL for games in memory
+
+   const char * buffer;
+   int buffer_size;
+   int buffer_pos;
 
    int char_hack;
    int char_line;
@@ -45,6 +50,7 @@ typedef struct {
 // functions
 
 extern void pgn_open      (pgn_t * pgn, const char file_name[]);
+extern void pgn_open_buffer (pgn_t * pgn, const char buffer[], int size, int line);
 extern void pgn_close     (pgn_t * pgn);
 
 extern bool pgn_next_game (pgn_t * pgn);
@@ -0,0 +1,743 @@
+
+// pgn_pipe.c
+
+// games of PGN files replayed in three stages: a reader cutting the files
+// into chunks of whole games, decoder threads turning each chunk into
+// (key, move, result) records, and the calling thread handing these over
+// in file order, so that the result does not depend on the thread count.
+// Files are read one after the other, the decoders share the chunks of
+// all of them
+
+// includes
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#ifndef _WIN32
+#  include <glob.h>
+#endif
+
+#include "board.h"
+#include "move.h"
+#include "move_do.h"
+#include "move_legal.h"
+#include "pgn.h"
+#include "pgn_pipe.h"
+#include "san.h"
+#include "stream.h"
+#include "thread.h"
+#include "util.h"
+
+// constants
+
+#define ChunkSize  (1<<18) // bytes read at a time
+#define SlotFactor 2       // chunks in flight per decoder
+
+// types
+
+enum { SlotFree, SlotRead, SlotDecoding, SlotDecoded };
+
+typedef struct {
+   int id;
+   int state;
+   char * text;
+   int text_size;
+   int text_alloc;
+   int file;       // index in Files
+   bool last;      // of its file
+   int line;       // of the first character in the file
+   int game;       // number of the first game in the file
+   double bytes;   // input offset after the chunk
+   pgn_pipe_move_t * move;
+   int move_nb;
+   int move_alloc;
+   int game_nb;
+} slot_t;
+
+// variables
+
+static const char * const PgnSuffix[] = { ".pgn", ".pgn.gz", ".pgn.bz2", ".pgn.xz", NULL };
+
+static const pgn_pipe_files_t * Files;
+static int MaxPly;
+
+static slot_t * Slot;
+static int SlotNb;
+static int NextDecode;
+static int ChunkEnd; // number of chunks, -1 until the reader is done
+
+static my_mutex_t PipeMutex[1];
+static my_cond_t PipeCond[1];
+
+static pgn_pipe_stats_t Stats[1];
+
+// prototypes
+
+static void path_add     (pgn_pipe_files_t * files, const char path[]);
+static void dir_add      (pgn_pipe_files_t * files, const char path[]);
+static int  name_compare (const void * p1, const void * p2);
+static bool name_is_pgn  (const char name[]);
+
+static void reader       (void * arg);
+static void decoder      (void * arg);
+
+static int  chunk_cut    (const char text[], int size, bool eof, int * line, int * game);
+static void chunk_decode (slot_t * slot);
+static void move_add     (slot_t * slot, const board_t * board, int ply, int move, int result);
+
+// functions
+
+// pgn_pipe_files_clear()
+
+void pgn_pipe_files_clear(pgn_pipe_files_t * files) {
+
+   ASSERT(files!=NULL);
+
+   files->size = 0;
+   files->alloc = 0;
+   files->name = NULL;
+   files->bytes = 0.0;
+}
+
+// pgn_pipe_files_free()
+
+void pgn_pipe_files_free(pgn_pipe_files_t * files) {
+
+   int i;
+
+   ASSERT(files!=NULL);
+
+   for (i = 0; i < files->size; i++) my_free(files->name[i]);
+   if (files->name != NULL) my_free(files->name);
+
+   pgn_pipe_files_clear(files);
+}
+
+// pgn_pipe_files_add()
+
+void pgn_pipe_files_add(pgn_pipe_files_t * files, const char path[]) {
+
+#ifndef _WIN32
+   glob_t match[1];
+   int i;
+#endif
+
+   ASSERT(files!=NULL);
+   ASSERT(path!=NULL);
+
+   // a quoted pattern is expanded here, one matching nothing is kept
+   // as a name so that opening it fails
+
+#ifndef _WIN32
+   if (strpbrk(path,"*?[") != NULL && glob(path,0,NULL,match) == 0) {
+      for (i = 0; i < (int) match->gl_pathc; i++) path_add(files,match->gl_pathv[i]);
+      globfree(match);
+      return;
+   }
+#endif
+
+   path_add(files,path);
+}
+
+// path_add()
+
+static void path_add(pgn_pipe_files_t * files, const char path[]) {
+
+   struct stat file_stat;
+
+   ASSERT(files!=NULL);
+   ASSERT(path!=NULL);
+
+   if (stat(path,&file_stat) == 0 && S_ISDIR(file_stat.st_mode)) {
+      dir_add(files,path);
+      return;
+   }
+
+   if (files->size == files->alloc) {
+      files->alloc = (files->alloc == 0) ? 16 : files->alloc * 2;
+      if (files->name == NULL) {
+         files->name = (char * *) my_malloc(files->alloc*sizeof(char *));
+      } else {
+         files->name = (char * *) my_realloc(files->name,files->alloc*sizeof(char *));
+      }
+   }
+
+   files->name[files->size++] = my_strdup(path);
+
+   if (stat(path,&file_stat) == 0 && S_ISREG(file_stat.st_mode)) files->bytes += (double) file_stat.st_size;
+}
+
+// dir_add()
+
+static void dir_add(pgn_pipe_files_t * files, const char path[]) {
+
+   DIR * dir;
+   struct dirent * dir_entry;
+   struct stat file_stat;
+   char * * name;
+   int name_nb, name_alloc;
+   char join_path[StringSize];
+   int i;
+
+   ASSERT(files!=NULL);
+   ASSERT(path!=NULL);
+
+   dir = opendir(path);
+   if (dir == NULL) my_fatal("dir_add(): can't open directory \"%s\": %s\n",path,strerror(errno));
+
+   name = NULL;
+   name_nb = 0;
+   name_alloc = 0;
+
+   while ((dir_entry = readdir(dir)) != NULL) {
+
+      if (dir_entry->d_name[0] == '.') continue; // also skips "." and ".."
+
+      if (name_nb == name_alloc) {
+         name_alloc = (name_alloc == 0) ? 64 : name_alloc * 2;
+         if (name == NULL) {
+            name = (char * *) my_malloc(name_alloc*sizeof(char *));
+         } else {
+            name = (char * *) my_realloc(name,name_alloc*sizeof(char *));
+         }
+      }
+
+      name[name_nb++] = my_strdup(dir_entry->d_name);
+   }
+
+   closedir(dir);
+
+   // sorted, so that the games come in the same order on every system
+
+   if (name_nb != 0) qsort(name,name_nb,sizeof(char *),&name_compare);
+
+   for (i = 0; i < name_nb; i++) {
+
+      my_path_join(join_path,path,name[i]);
+
+      if (stat(join_path,&file_stat) == 0 && S_ISDIR(file_stat.st_mode)) {
+         dir_add(files,join_path);
+      } else if (name_is_pgn(name[i])) {
+         path_add(files,join_path);
+      }
+
+      my_free(name[i]);
+   }
+
+   if (name != NULL) my_free(name);
+}
+
+// name_compare()
+
+static int name_compare(const void * p1, const void * p2) {
+
+   ASSERT(p1!=NULL);
+   ASSERT(p2!=NULL);
+
+   return strcmp(*(char * const *) p1,*(char * const *) p2);
+}
+
+// name_is_pgn()
+
+static bool name_is_pgn(const char name[]) {
+
+   size_t length, suffix;
+   int i;
+
+   ASSERT(name!=NULL);
+
+   // compressed files are told apart by stream_open(), not by their name
+
+   length = strlen(name);
+
+   for (i = 0; PgnSuffix[i] != NULL; i++) {
+      suffix = strlen(PgnSuffix[i]);
+      if (length > suffix && my_string_case_equal(name+length-suffix,PgnSuffix[i])) return TRUE;
+   }
+
+   return FALSE;
+}
+
+// pgn_pipe_run()
+
+void pgn_pipe_run(const pgn_pipe_files_t * files, int max_ply, int thread_nb,
+                  pgn_pipe_func_t func, void * arg, pgn_pipe_stats_t * stats) {
+
+   my_thread_t read_thread;
+   my_thread_t * thread;
+   pgn_pipe_pos_t pos[1];
+   slot_t * slot;
+   double start;
+   int id;
+   int i;
+
+   ASSERT(files!=NULL);
+   ASSERT(max_ply>=0);
+   ASSERT(thread_nb>=1);
+   ASSERT(func!=NULL);
+
+   Files = files;
+   MaxPly = max_ply;
+
+   memset(Stats,0,sizeof(pgn_pipe_stats_t));
+   Stats->thread_nb = thread_nb;
+
+   // the slots bound the memory in use, a stage ahead of the others waits
+
+   SlotNb = thread_nb * SlotFactor + 2;
+   Slot = (slot_t *) my_malloc(SlotNb*sizeof(slot_t));
+   memset(Slot,0,SlotNb*sizeof(slot_t));
+
+   NextDecode = 0;
+   ChunkEnd = -1;
+
+   my_mutex_init(PipeMutex);
+   my_cond_init(PipeCond);
+
+   my_thread_create(&read_thread,reader,NULL);
+
+   thread = (my_thread_t *) my_malloc(thread_nb*sizeof(my_thread_t));
+   for (i = 0; i < thread_nb; i++) my_thread_create(&thread[i],decoder,NULL);
+
+   // apply the chunks in file order
+
+   pos->bytes = 0.0;
+   pos->game_nb = 0;
+   pos->file_nb = Files->size;
+   pos->file_name = NULL;
+   pos->file_game_nb = 0;
+   pos->file_end = FALSE;
+
+   for (id = 0; TRUE; id++) {
+
+      slot = &Slot[id%SlotNb];
+
+      my_mutex_lock(PipeMutex);
+
+      if (!(slot->id == id && slot->state == SlotDecoded) && !(ChunkEnd >= 0 && id >= ChunkEnd)) {
+         Stats->apply_wait++;
+         while (!(slot->id == id && slot->state == SlotDecoded) && !(ChunkEnd >= 0 && id >= ChunkEnd)) {
+            my_cond_wait(PipeCond,PipeMutex);
+         }
+      }
+
+      if (ChunkEnd >= 0 && id >= ChunkEnd) {
+         my_mutex_unlock(PipeMutex);
+         break;
+      }
+
+      for (i = 0; i < SlotNb; i++) {
+         if (Slot[i].state == SlotRead) Stats->read_queue++;
+         if (Slot[i].state == SlotDecoded) Stats->decode_queue++;
+      }
+
+      my_mutex_unlock(PipeMutex);
+
+      start = now_real();
+
+      if (pos->file_name != Files->name[slot->file]) {
+         pos->file_name = Files->name[slot->file];
+         pos->file_game_nb = 0;
+      }
+
+      pos->bytes = slot->bytes;
+      pos->game_nb += slot->game_nb;
+      pos->file_game_nb += slot->game_nb;
+      pos->file_end = slot->last;
+
+      func(slot->move,slot->move_nb,pos,arg);
+
+      Stats->game_nb += slot->game_nb;
+      Stats->move_nb += slot->move_nb;
+      Stats->apply_time += now_real() - start;
+
+      my_mutex_lock(PipeMutex);
+      slot->state = SlotFree;
+      my_cond_broadcast(PipeCond);
+      my_mutex_unlock(PipeMutex);
+   }
+
+   my_thread_join(&read_thread);
+   for (i = 0; i < thread_nb; i++) my_thread_join(&thread[i]);
+   my_free(thread);
+
+   my_cond_free(PipeCond);
+   my_mutex_free(PipeMutex);
+
+   Stats->chunk_nb = ChunkEnd;
+   Stats->bytes = pos->bytes;
+
+   if (ChunkEnd > 0) {
+      Stats->read_queue /= ChunkEnd;
+      Stats->decode_queue /= ChunkEnd;
+   }
+
+   for (i = 0; i < SlotNb; i++) {
+      if (Slot[i].text != NULL) my_free(Slot[i].text);
+      if (Slot[i].move != NULL) my_free(Slot[i].move);
+   }
+   my_free(Slot);
+
+   if (stats != NULL) *stats = *Stats;
+}
+
+// pgn_pipe_print()
+
+void pgn_pipe_print(const pgn_pipe_stats_t * stats) {
+
+   ASSERT(stats!=NULL);
+
+   printf("read   : %.1fMB in %d chunks, %.2fs busy, %d waits for room\n",
+          stats->bytes/1048576.0,stats->chunk_nb,stats->read_time,stats->read_wait);
+   printf("decode : %d games, %.0f moves, %.2fs busy on %d thread%s, %d waits for input\n",
+          stats->game_nb,stats->move_nb,stats->decode_time,stats->thread_nb,(stats->thread_nb>1)?"s":"",stats->decode_wait);
+   printf("apply  : %.2fs busy, %d waits for input\n",stats->apply_time,stats->apply_wait);
+   printf("queues : %.1f chunks waiting for a decoder, %.1f waiting to be applied\n",
+          stats->read_queue,stats->decode_queue);
+}
+
+// reader()
+
+static void reader(void * arg) {
+
+   stream_t file[1];
+   char * carry;
+   int carry_size;
+   int carry_alloc;
+   slot_t * slot;
+   double bytes, file_bytes;
+   double start;
+   bool eof;
+   int line, game;
+   int size;
+   int cut;
+   int file_id;
+   int id;
+
+   (void) arg; // unused
+
+   carry = NULL;
+   carry_size = 0;
+   carry_alloc = 0;
+
+   bytes = 0.0;
+   id = 0;
+
+   for (file_id = 0; file_id < Files->size; file_id++) {
+
+      // compressed files are inflated here, while the decoders parse
+
+      if (!stream_open(file,Files->name[file_id])) {
+         my_fatal("reader(): can't open file \"%s\": %s\n",Files->name[file_id],strerror(errno));
+         continue;
+      }
+
+      line = 1;
+      game = 1;
+      eof = FALSE;
+      file_bytes = 0.0;
+
+      // chunks never span two files
+
+      ASSERT(carry_size==0);
+
+      while (!eof || carry_size != 0) {
+
+         slot = &Slot[id%SlotNb];
+
+         my_mutex_lock(PipeMutex);
+         if (slot->state != SlotFree) {
+            Stats->read_wait++;
+            while (slot->state != SlotFree) my_cond_wait(PipeCond,PipeMutex);
+         }
+         my_mutex_unlock(PipeMutex);
+
+         start = now_real();
+
+         // the unfinished game of the last chunk starts this one
+
+         if (slot->text_alloc < carry_size + ChunkSize) {
+            if (slot->text != NULL) my_free(slot->text);
+            slot->text_alloc = carry_size + ChunkSize;
+            slot->text = (char *) my_malloc(slot->text_alloc);
+         }
+
+         if (carry_size != 0) memcpy(slot->text,carry,carry_size);
+         size = carry_size;
+
+         slot->file = file_id;
+         slot->line = line;
+         slot->game = game;
+
+         while (TRUE) {
+
+            if (!eof) {
+
+               if (slot->text_alloc < size + ChunkSize) {
+                  slot->text_alloc = size + ChunkSize;
+                  slot->text = (char *) my_realloc(slot->text,slot->text_alloc);
+               }
+
+               cut = stream_read(file,slot->text+size,ChunkSize);
+               size += cut;
+               eof = (cut == 0);
+            }
+
+            // a game longer than a chunk makes the chunk grow
+
+            cut = chunk_cut(slot->text,size,eof,&line,&game);
+            if (cut != 0 || eof) break;
+         }
+
+         carry_size = size - cut;
+
+         if (carry_size > carry_alloc) {
+            if (carry != NULL) my_free(carry);
+            carry_alloc = carry_size + ChunkSize;
+            carry = (char *) my_malloc(carry_alloc);
+         }
+
+         if (carry_size != 0) memcpy(carry,slot->text+cut,carry_size);
+
+         file_bytes += cut;
+
+         // progress is in file bytes, the sizes known beforehand
+
+         slot->text_size = cut;
+         slot->bytes = bytes + ((file->type == StreamPlain) ? file_bytes : stream_tell(file));
+         slot->last = eof && carry_size == 0;
+
+         Stats->read_time += now_real() - start;
+
+         my_mutex_lock(PipeMutex);
+         slot->id = id++;
+         slot->state = SlotRead;
+         my_cond_broadcast(PipeCond);
+         my_mutex_unlock(PipeMutex);
+      }
+
+      bytes += stream_tell(file);
+
+      stream_close(file);
+   }
+
+   if (carry != NULL) my_free(carry);
+
+   my_mutex_lock(PipeMutex);
+   ChunkEnd = id;
+   my_cond_broadcast(PipeCond);
+   my_mutex_unlock(PipeMutex);
+}
+
+// decoder()
+
+static void decoder(void * arg) {
+
+   slot_t * slot;
+   double start;
+
+   (void) arg; // unused
+
+   while (TRUE) {
+
+      my_mutex_lock(PipeMutex);
+
+      slot = &Slot[NextDecode%SlotNb];
+
+      if (!(slot->id == NextDecode && slot->state == SlotRead) && !(ChunkEnd >= 0 && NextDecode >= ChunkEnd)) {
+         Stats->decode_wait++;
+         while (TRUE) {
+            slot = &Slot[NextDecode%SlotNb];
+            if (slot->id == NextDecode && slot->state == SlotRead) break;
+            if (ChunkEnd >= 0 && NextDecode >= ChunkEnd) break;
+            my_cond_wait(PipeCond,PipeMutex);
+         }
+      }
+
+      if (ChunkEnd >= 0 && NextDecode >= ChunkEnd) {
+         my_mutex_unlock(PipeMutex);
+         break;
+      }
+
+      NextDecode++;
+      slot->state = SlotDecoding;
+
+      my_mutex_unlock(PipeMutex);
+
+      start = now_real();
+      chunk_decode(slot);
+      start = now_real() - start;
+
+      my_mutex_lock(PipeMutex);
+      Stats->decode_time += start;
+      slot->state = SlotDecoded;
+      my_cond_broadcast(PipeCond);
+      my_mutex_unlock(PipeMutex);
+   }
+}
+
+// chunk_cut()
+
+static int chunk_cut(const char text[], int size, bool eof, int * line, int * game) {
+
+   bool comment, line_comment;
+   bool line_start;
+   bool moves;
+   int cut, cut_line, cut_game;
+   int line_nb, game_nb;
+   int pos;
+
+   ASSERT(text!=NULL);
+   ASSERT(line!=NULL);
+   ASSERT(game!=NULL);
+
+   // a game starts with a tag line after the moves of the previous one;
+   // tags inside comments do not count
+
+   comment = FALSE;
+   line_comment = FALSE;
+   line_start = TRUE;
+   moves = FALSE;
+
+   cut = 0;
+   cut_line = 0;
+   cut_game = 0;
+
+   line_nb = 0;
+   game_nb = 0;
+
+   for (pos = 0; pos < size; pos++) {
+
+      if (text[pos] == '\n') {
+         line_nb++;
+         line_start = TRUE;
+         line_comment = FALSE;
+         continue;
+      }
+
+      if (FALSE) {
+      } else if (comment) {
+         if (text[pos] == '}') comment = FALSE;
+      } else if (line_comment) {
+         // skip
+      } else if (text[pos] == '{') {
+         comment = TRUE;
+         moves = TRUE;
+      } else if (text[pos] == ';') {
+         line_comment = TRUE;
+      } else if (line_start && text[pos] == '[') {
+         if (moves) {
+            cut = pos;
+            cut_line = line_nb;
+            cut_game = ++game_nb;
+            moves = FALSE;
+         }
+         line_comment = TRUE; // the rest of a tag line is not move text
+      } else if (text[pos] != ' ' && text[pos] != '\t' && text[pos] != '\r') {
+         moves = TRUE;
+      }
+
+      if (text[pos] != ' ' && text[pos] != '\t' && text[pos] != '\r') line_start = FALSE;
+   }
+
+   if (eof) {
+      cut = size;
+      cut_line = line_nb;
+      cut_game = game_nb + 1;
+   }
+
+   *line += cut_line;
+   *game += cut_game;
+
+   return cut;
+}
+
+// chunk_decode()
+
+static void chunk_decode(slot_t * slot) {
+
+   pgn_t pgn[1];
+   board_t board[1];
+   char string[256];
+   int ply;
+   int result;
+   int move;
+
+   ASSERT(slot!=NULL);
+
+   slot->move_nb = 0;
+   slot->game_nb = 0;
+
+   pgn_open_buffer(pgn,slot->text,slot->text_size,slot->line);
+   pgn->game_nb = slot->game;
+
+   while (pgn_next_game(pgn)) {
+
+      board_start(board);
+      ply = 0;
+      result = 0;
+
+      if (FALSE) {
+      } else if (my_string_equal(pgn->result,"1-0")) {
+         result = +1;
+      } else if (my_string_equal(pgn->result,"0-1")) {
+         result = -1;
+      }
+
+      while (pgn_next_move(pgn,string,256)) {
+
+         if (ply < MaxPly) {
+
+            move = move_from_san(string,board);
+
+            if (move == MoveNone || !move_is_legal(move,board)) {
+               my_fatal("book_insert(): illegal move \"%s\" at line %d, column %d,game %d of \"%s\"\n",string,pgn->move_line,pgn->move_column,pgn->game_nb,Files->name[slot->file]);
+            }
+
+            move_add(slot,board,ply,move,result);
+
+            move_do(board,move);
+            ply++;
+            result = -result;
+         }
+      }
+
+      pgn->game_nb++;
+      slot->game_nb++;
+   }
+
+   pgn_close(pgn);
+}
+
+// move_add()
+
+static void move_add(slot_t * slot, const board_t * board, int ply, int move, int result) {
+
+   pgn_pipe_move_t * entry;
+
+   ASSERT(slot!=NULL);
+   ASSERT(board!=NULL);
+
+   if (slot->move_nb == slot->move_alloc) {
+      slot->move_alloc = (slot->move_alloc == 0) ? 65536 : slot->move_alloc * 2;
+      if (slot->move == NULL) {
+         slot->move = (pgn_pipe_move_t *) my_malloc(slot->move_alloc*sizeof(pgn_pipe_move_t));
+      } else {
+         slot->move = (pgn_pipe_move_t *) my_realloc(slot->move,slot->move_alloc*sizeof(pgn_pipe_move_t));
+      }
+   }
+
+   entry = &slot->move[slot->move_nb++];
+
+   entry->key = board->key;
+   entry->move = move;
+   entry->ply = ply;
+   entry->colour = board->turn;
+   entry->result = result;
+}
+
+// end of pgn_pipe.c
@@ -0,0 +1,68 @@
+
+// pgn_pipe.h
+
+#ifndef PGN_PIPE_H
+#define PGN_PIPE_H
+
+// includes
+
+#include "util.h"
+
+// types
+
+typedef struct {
+   uint64 key;
+   uint16 move;
+   uint16 ply;
+   sint8 colour; // side to move
+   sint8 result; // -1, 0 or +1 for the side to move
+} pgn_pipe_move_t;
+
+typedef struct {
+   int size;
+   int alloc;
+   char * * name;
+   double bytes; // sum of the file sizes
+} pgn_pipe_files_t;
+
+typedef struct {
+   double bytes;       // input consumed so far
+   int game_nb;        // games so far
+   int file_nb;        // files in the input
+   const char * file_name;
+   int file_game_nb;   // games so far in this file
+   bool file_end;      // the last records of this file
+} pgn_pipe_pos_t;
+
+typedef void (*pgn_pipe_func_t) (const pgn_pipe_move_t move[], int move_nb, const pgn_pipe_pos_t * pos, void * arg);
+
+typedef struct {
+   int thread_nb;
+   int chunk_nb;
+   double bytes;
+   int game_nb;
+   double move_nb;
+   double read_time;    // busy time of each stage, in seconds
+   double decode_time;  // summed over the decoder threads
+   double apply_time;
+   int read_wait;       // times a stage found no room or nothing to do
+   int decode_wait;
+   int apply_wait;
+   double read_queue;   // average chunks waiting for a decoder
+   double decode_queue; // average chunks waiting to be applied
+} pgn_pipe_stats_t;
+
+// functions
+
+extern void pgn_pipe_files_clear (pgn_pipe_files_t * files);
+extern void pgn_pipe_files_free  (pgn_pipe_files_t * files);
+extern void pgn_pipe_files_add   (pgn_pipe_files_t * files, const char path[]);
+
+extern void pgn_pipe_run   (const pgn_pipe_files_t * files, int max_ply, int thread_nb,
+                            pgn_pipe_func_t func, void * arg, pgn_pipe_stats_t * stats);
+
+extern void pgn_pipe_print (const pgn_pipe_stats_t * stats);
+
+#endif // !defined PGN_PIPE_H
+
+// end of pgn_pipe.h
@@ -12,6 +12,7 @@
 #include "board.h"
 #include "list.h"
 #include "move.h"
+#include "move_do.h"
 #include "move_gen.h"
 #include "move_legal.h"
 #include "piece.h"
@@ -41,6 +42,7 @@ static int  ambiguity     (int move, const board_t * board);
 
 bool move_to_san(int move, const board_t * board, char string[], int size) {
 
+   board_t new_board[1];
    int from, to, piece;
    char tmp_string[256];
 
@@ -136,10 +138,10 @@ bool move_to_san(int move, const board_t * board, char string[], int size) {
 
 check:
 
-   if (move_is_mate(move,board)) {
-      strcat(string,"#");
-   } else if (move_is_check(move,board)) {
-      strcat(string,"+");
+   if (move_is_check(move,board)) {
+      board_copy(new_board,board);
+      move_do(new_board,move);
+      strcat(string,(board_is_mate(new_board))?"#":"+");
    }
 
    return TRUE;
@@ -508,8 +510,9 @@ static int move_from_lan(const char string[], const board_t * board) {
 static int ambiguity(int move, const board_t * board) {
 
    int from, to, piece;
-   list_t list[1];
-   int i, n, m;
+   const uint8 * ptr;
+   int sq;
+   int n, file_n, rank_n;
 
    // init
 
@@ -517,46 +520,34 @@ static int ambiguity(int move, const board_t * board) {
    to = move_to(move);
    piece = move_piece(move,board);
 
-   gen_legal_moves(list,board);
-
-   // no ambiguity?
+   // other pieces of the same type that can legally go to "to"
 
    n = 0;
+   file_n = 0;
+   rank_n = 0;
 
-   for (i = 0; i < list_size(list); i++) {
-      m = list_move(list,i);
-      if (move_piece(m,board) == piece && move_to(m) == to) {
-         n++;
-      }
-   }
-
-   if (n == 1) return AMBIGUITY_NONE;
+   for (ptr = board->list[board->turn]; (sq=*ptr) != SquareNone; ptr++) {
 
-   // file ambiguity?
-
-   n = 0;
+      if (sq == from || board->square[sq] != piece) continue;
+      if (!piece_attack(board,piece,sq,to)) continue;
+      if (!pseudo_is_legal(move_make(sq,to),board)) continue;
 
-   for (i = 0; i < list_size(list); i++) {
-      m = list_move(list,i);
-      if (move_piece(m,board) == piece && move_to(m) == to) {
-         if (square_file(move_from(m)) == square_file(from)) n++;
-      }
+      n++;
+      if (square_file(sq) == square_file(from)) file_n++;
+      if (square_rank(sq) == square_rank(from)) rank_n++;
    }
 
-   if (n == 1) return AMBIGUITY_FILE;
+   // no ambiguity?
 
-   // rank ambiguity?
+   if (n == 0) return AMBIGUITY_NONE;
 
-   n = 0;
+   // file ambiguity?
 
-   for (i = 0; i < list_size(list); i++) {
-      m = list_move(list,i);
-      if (move_piece(m,board) == piece && move_to(m) == to) {
-         if (square_rank(move_from(m)) == square_rank(from)) n++;
-      }
-   }
+   if (file_n == 0) return AMBIGUITY_FILE;
+
+   // rank ambiguity?
 
-   if (n == 1) return AMBIGUITY_RANK;
+   if (rank_n == 0) return AMBIGUITY_RANK;
 
    // square ambiguity
 
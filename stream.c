@@ -0,0 +1,416 @@
+
+// stream.c
+
+// files read through a decompressor chosen by their first bytes; each
+// library is only used when the build defines HAVE_ZLIB, HAVE_BZLIB or
+// HAVE_LZMA (and links -lz, -lbz2 or -llzma)
+
+// includes
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#  include <zlib.h>
+#endif
+#ifdef HAVE_BZLIB
+#  include <bzlib.h>
+#endif
+#ifdef HAVE_LZMA
+#  include <lzma.h>
+#endif
+
+#include "stream.h"
+#include "util.h"
+
+// constants
+
+#define InSize (1<<18) // file bytes read at a time
+
+// prototypes
+
+static bool stream_fill  (stream_t * stream);
+
+#ifdef HAVE_ZLIB
+static int  gzip_read    (stream_t * stream, char buffer[], int size);
+#endif
+#ifdef HAVE_BZLIB
+static int  bzip2_read   (stream_t * stream, char buffer[], int size);
+#endif
+#ifdef HAVE_LZMA
+static int  xz_read      (stream_t * stream, char buffer[], int size);
+#endif
+
+// functions
+
+// stream_open()
+
+bool stream_open(stream_t * stream, const char file_name[]) {
+
+   const char * define;
+
+   ASSERT(stream!=NULL);
+   ASSERT(file_name!=NULL);
+
+   stream->file = fopen(file_name,"rb");
+   if (stream->file == NULL) return FALSE;
+
+   stream->in = (char *) my_malloc(InSize);
+   stream->in_size = 0;
+   stream->in_pos = 0;
+   stream->in_eof = FALSE;
+   stream->end = FALSE;
+   stream->in_bytes = 0.0;
+   stream->state = NULL;
+
+   stream_fill(stream);
+
+   // magic bytes
+
+   if (FALSE) {
+   } else if (stream->in_size >= 2 && (uint8) stream->in[0] == 0x1F && (uint8) stream->in[1] == 0x8B) {
+      stream->type = StreamGzip;
+   } else if (stream->in_size >= 3 && memcmp(stream->in,"BZh",3) == 0) {
+      stream->type = StreamBzip2;
+   } else if (stream->in_size >= 6 && memcmp(stream->in,"\xFD" "7zXZ\0",6) == 0) {
+      stream->type = StreamXz;
+   } else {
+      stream->type = StreamPlain;
+   }
+
+   define = NULL;
+
+   switch (stream->type) {
+
+   case StreamGzip:
+#ifdef HAVE_ZLIB
+      stream->state = my_malloc(sizeof(z_stream));
+      memset(stream->state,0,sizeof(z_stream));
+      if (inflateInit2((z_stream *) stream->state,15+32) != Z_OK) my_fatal("stream_open(): inflateInit2() failed\n");
+#else
+      define = "HAVE_ZLIB";
+#endif
+      break;
+
+   case StreamBzip2:
+#ifdef HAVE_BZLIB
+      stream->state = my_malloc(sizeof(bz_stream));
+      memset(stream->state,0,sizeof(bz_stream));
+      if (BZ2_bzDecompressInit((bz_stream *) stream->state,0,0) != BZ_OK) my_fatal("stream_open(): BZ2_bzDecompressInit() failed\n");
+#else
+      define = "HAVE_BZLIB";
+#endif
+      break;
+
+   case StreamXz:
+#ifdef HAVE_LZMA
+      stream->state = my_malloc(sizeof(lzma_stream));
+      memset(stream->state,0,sizeof(lzma_stream));
+      if (lzma_stream_decoder((lzma_stream *) stream->state,UINT64_MAX,LZMA_CONCATENATED) != LZMA_OK) my_fatal("stream_open(): lzma_stream_decoder() failed\n");
+#else
+      define = "HAVE_LZMA";
+#endif
+      break;
+   }
+
+   if (define != NULL) {
+      stream_close(stream);
+      errno = ENOSYS; // for callers that report the failure again
+      my_fatal("stream_open(): \"%s\" is %s compressed, rebuild with -D%s\n",file_name,stream_name(stream),define);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+// stream_close()
+
+void stream_close(stream_t * stream) {
+
+   ASSERT(stream!=NULL);
+
+   if (stream->state != NULL) {
+
+      switch (stream->type) {
+#ifdef HAVE_ZLIB
+      case StreamGzip:
+         inflateEnd((z_stream *) stream->state);
+         break;
+#endif
+#ifdef HAVE_BZLIB
+      case StreamBzip2:
+         BZ2_bzDecompressEnd((bz_stream *) stream->state);
+         break;
+#endif
+#ifdef HAVE_LZMA
+      case StreamXz:
+         lzma_end((lzma_stream *) stream->state);
+         break;
+#endif
+      }
+
+      my_free(stream->state);
+      stream->state = NULL;
+   }
+
+   my_free(stream->in);
+   fclose(stream->file);
+}
+
+// stream_read()
+
+int stream_read(stream_t * stream, char buffer[], int size) {
+
+   int n;
+
+   ASSERT(stream!=NULL);
+   ASSERT(buffer!=NULL);
+   ASSERT(size>0);
+
+   // returns 0 at the end only
+
+   switch (stream->type) {
+#ifdef HAVE_ZLIB
+   case StreamGzip:
+      return gzip_read(stream,buffer,size);
+#endif
+#ifdef HAVE_BZLIB
+   case StreamBzip2:
+      return bzip2_read(stream,buffer,size);
+#endif
+#ifdef HAVE_LZMA
+   case StreamXz:
+      return xz_read(stream,buffer,size);
+#endif
+   }
+
+   ASSERT(stream->type==StreamPlain);
+
+   if (stream->in_pos < stream->in_size) {
+      n = stream->in_size - stream->in_pos;
+      if (n > size) n = size;
+      memcpy(buffer,stream->in+stream->in_pos,n);
+      stream->in_pos += n;
+   } else if (!stream->in_eof) {
+      n = (int) fread(buffer,1,size,stream->file);
+      if (ferror(stream->file)) my_fatal("stream_read(): fread(): %s\n",strerror(errno));
+      stream->in_eof = feof(stream->file);
+   } else {
+      n = 0;
+   }
+
+   stream->in_bytes += n;
+
+   return n;
+}
+
+// stream_tell()
+
+double stream_tell(const stream_t * stream) {
+
+   ASSERT(stream!=NULL);
+
+   return stream->in_bytes;
+}
+
+// stream_name()
+
+const char * stream_name(const stream_t * stream) {
+
+   ASSERT(stream!=NULL);
+
+   switch (stream->type) {
+   case StreamGzip:  return "gzip";
+   case StreamBzip2: return "bzip2";
+   case StreamXz:    return "xz";
+   }
+
+   return "plain";
+}
+
+// stream_fill()
+
+static bool stream_fill(stream_t * stream) {
+
+   ASSERT(stream!=NULL);
+
+   // returns FALSE when the file has no more bytes
+
+   if (stream->in_pos < stream->in_size) return TRUE;
+   if (stream->in_eof) return FALSE;
+
+   stream->in_size = (int) fread(stream->in,1,InSize,stream->file);
+   stream->in_pos = 0;
+
+   if (ferror(stream->file)) my_fatal("stream_fill(): fread(): %s\n",strerror(errno));
+   stream->in_eof = feof(stream->file);
+
+   return stream->in_size != 0;
+}
+
+#ifdef HAVE_ZLIB
+
+// gzip_read()
+
+static int gzip_read(stream_t * stream, char buffer[], int size) {
+
+   z_stream * z;
+   int avail;
+   int ret;
+
+   ASSERT(stream!=NULL);
+   ASSERT(buffer!=NULL);
+
+   z = (z_stream *) stream->state;
+
+   z->next_out = (Bytef *) buffer;
+   z->avail_out = size;
+
+   while (z->avail_out == (uInt) size && !stream->end) {
+
+      if (!stream_fill(stream)) {
+         my_fatal("gzip_read(): truncated input\n");
+         break;
+      }
+
+      avail = stream->in_size - stream->in_pos;
+
+      z->next_in = (Bytef *) stream->in + stream->in_pos;
+      z->avail_in = avail;
+
+      ret = inflate(z,Z_NO_FLUSH);
+
+      stream->in_pos += avail - z->avail_in;
+      stream->in_bytes += avail - z->avail_in;
+
+      if (ret == Z_STREAM_END) {
+
+         // gzip members can follow each other
+
+         if (stream_fill(stream)) {
+            inflateReset(z);
+         } else {
+            stream->end = TRUE;
+         }
+
+      } else if (ret != Z_OK) {
+
+         my_fatal("gzip_read(): inflate(): %s\n",(z->msg!=NULL)?z->msg:"error");
+         break;
+      }
+   }
+
+   return size - z->avail_out;
+}
+
+#endif
+
+#ifdef HAVE_BZLIB
+
+// bzip2_read()
+
+static int bzip2_read(stream_t * stream, char buffer[], int size) {
+
+   bz_stream * bz;
+   int avail;
+   int ret;
+
+   ASSERT(stream!=NULL);
+   ASSERT(buffer!=NULL);
+
+   bz = (bz_stream *) stream->state;
+
+   bz->next_out = buffer;
+   bz->avail_out = size;
+
+   while (bz->avail_out == (unsigned int) size && !stream->end) {
+
+      if (!stream_fill(stream)) {
+         my_fatal("bzip2_read(): truncated input\n");
+         break;
+      }
+
+      avail = stream->in_size - stream->in_pos;
+
+      bz->next_in = stream->in + stream->in_pos;
+      bz->avail_in = avail;
+
+      ret = BZ2_bzDecompress(bz);
+
+      stream->in_pos += avail - bz->avail_in;
+      stream->in_bytes += avail - bz->avail_in;
+
+      if (ret == BZ_STREAM_END) {
+
+         // as written by parallel compressors, one stream per block
+
+         if (stream_fill(stream)) {
+            BZ2_bzDecompressEnd(bz);
+            if (BZ2_bzDecompressInit(bz,0,0) != BZ_OK) my_fatal("bzip2_read(): BZ2_bzDecompressInit() failed\n");
+            bz->next_out = buffer + (size - bz->avail_out);
+         } else {
+            stream->end = TRUE;
+         }
+
+      } else if (ret != BZ_OK) {
+
+         my_fatal("bzip2_read(): BZ2_bzDecompress(): error %d\n",ret);
+         break;
+      }
+   }
+
+   return size - bz->avail_out;
+}
+
+#endif
+
+#ifdef HAVE_LZMA
+
+// xz_read()
+
+static int xz_read(stream_t * stream, char buffer[], int size) {
+
+   lzma_stream * lz;
+   int avail;
+   int ret;
+
+   ASSERT(stream!=NULL);
+   ASSERT(buffer!=NULL);
+
+   lz = (lzma_stream *) stream->state;
+
+   lz->next_out = (uint8_t *) buffer;
+   lz->avail_out = size;
+
+   while (lz->avail_out == (size_t) size && !stream->end) {
+
+      // concatenated streams are handled by the decoder, it is told
+      // when there is no more input
+
+      stream_fill(stream);
+
+      avail = stream->in_size - stream->in_pos;
+
+      lz->next_in = (const uint8_t *) stream->in + stream->in_pos;
+      lz->avail_in = avail;
+
+      ret = lzma_code(lz,(avail == 0 && stream->in_eof) ? LZMA_FINISH : LZMA_RUN);
+
+      stream->in_pos += avail - (int) lz->avail_in;
+      stream->in_bytes += avail - (int) lz->avail_in;
+
+      if (ret == LZMA_STREAM_END) {
+         stream->end = TRUE;
+      } else if (ret != LZMA_OK) {
+         my_fatal("xz_read(): lzma_code(): error %d\n",ret);
+         break;
+      }
+   }
+
+   return size - (int) lz->avail_out;
+}
+
+#endif
+
+// end of stream.c
@@ -0,0 +1,43 @@
+
+// stream.h
+
+#ifndef STREAM_H
+#define STREAM_H
+
+// includes
+
+#include <stdio.h>
+
+#include "util.h"
+
+// constants
+
+enum { StreamPlain, StreamGzip, StreamBzip2, StreamXz };
+
+// types
+
+typedef struct {
+   FILE * file;
+   int type;
+   void * state;       // of the decompressor
+   char * in;          // file bytes not consumed yet
+   int in_size;
+   int in_pos;
+   bool in_eof;
+   bool end;           // of the last compressed stream
+   double in_bytes;    // file bytes consumed
+} stream_t;
+
+// functions
+
+extern bool         stream_open  (stream_t * stream, const char file_name[]);
+extern void         stream_close (stream_t * stream);
+
+extern int          stream_read  (stream_t * stream, char buffer[], int size);
+extern double       stream_tell  (const stream_t * stream);
+
+extern const char * stream_name  (const stream_t * stream);
+
+#endif // !defined STREAM_H
+
+// end of stream.h
@@ -0,0 +1,256 @@
+
+// thread.c
+
+// includes
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "thread.h"
+#include "util.h"
+
+// types
+
+typedef struct {
+   my_thread_func_t func;
+   void * arg;
+} start_t;
+
+// prototypes
+
+#ifdef _WIN32
+static DWORD WINAPI thread_start (LPVOID arg);
+#else
+static void *       thread_start (void * arg);
+#endif
+
+// functions
+
+// my_thread_create()
+
+void my_thread_create(my_thread_t * thread, my_thread_func_t func, void * arg) {
+
+   start_t * start;
+
+   ASSERT(thread!=NULL);
+   ASSERT(func!=NULL);
+
+   start = (start_t *) my_malloc(sizeof(start_t));
+   start->func = func;
+   start->arg = arg;
+
+#ifdef _WIN32
+   *thread = CreateThread(NULL,0,thread_start,start,0,NULL);
+   if (*thread == NULL) my_fatal("my_thread_create(): CreateThread(): error %lu\n",GetLastError());
+#else
+   errno = pthread_create(thread,NULL,thread_start,start);
+   if (errno != 0) my_fatal("my_thread_create(): pthread_create(): %s\n",strerror(errno));
+#endif
+}
+
+// my_thread_join()
+
+void my_thread_join(my_thread_t * thread) {
+
+   ASSERT(thread!=NULL);
+
+#ifdef _WIN32
+   WaitForSingleObject(*thread,INFINITE);
+   CloseHandle(*thread);
+#else
+   pthread_join(*thread,NULL);
+#endif
+}
+
+// my_thread_detach()
+
+void my_thread_detach(my_thread_t * thread) {
+
+   ASSERT(thread!=NULL);
+
+#ifdef _WIN32
+   CloseHandle(*thread);
+#else
+   pthread_detach(*thread);
+#endif
+}
+
+// my_mutex_init()
+
+void my_mutex_init(my_mutex_t * mutex) {
+
+   ASSERT(mutex!=NULL);
+
+#ifdef _WIN32
+   InitializeCriticalSection(mutex);
+#else
+   pthread_mutex_init(mutex,NULL);
+#endif
+}
+
+// my_mutex_free()
+
+void my_mutex_free(my_mutex_t * mutex) {
+
+   ASSERT(mutex!=NULL);
+
+#ifdef _WIN32
+   DeleteCriticalSection(mutex);
+#else
+   pthread_mutex_destroy(mutex);
+#endif
+}
+
+// my_mutex_lock()
+
+void my_mutex_lock(my_mutex_t * mutex) {
+
+   ASSERT(mutex!=NULL);
+
+#ifdef _WIN32
+   EnterCriticalSection(mutex);
+#else
+   pthread_mutex_lock(mutex);
+#endif
+}
+
+// my_mutex_unlock()
+
+void my_mutex_unlock(my_mutex_t * mutex) {
+
+   ASSERT(mutex!=NULL);
+
+#ifdef _WIN32
+   LeaveCriticalSection(mutex);
+#else
+   pthread_mutex_unlock(mutex);
+#endif
+}
+
+// my_cond_init()
+
+void my_cond_init(my_cond_t * cond) {
+
+   ASSERT(cond!=NULL);
+
+#ifdef _WIN32
+   InitializeConditionVariable(cond);
+#else
+   pthread_cond_init(cond,NULL);
+#endif
+}
+
+// my_cond_free()
+
+void my_cond_free(my_cond_t * cond) {
+
+   ASSERT(cond!=NULL);
+
+#ifndef _WIN32
+   pthread_cond_destroy(cond);
+#endif
+}
+
+// my_cond_wait()
+
+void my_cond_wait(my_cond_t * cond, my_mutex_t * mutex) {
+
+   ASSERT(cond!=NULL);
+   ASSERT(mutex!=NULL);
+
+#ifdef _WIN32
+   SleepConditionVariableCS(cond,mutex,INFINITE);
+#else
+   pthread_cond_wait(cond,mutex);
+#endif
+}
+
+// my_cond_signal()
+
+void my_cond_signal(my_cond_t * cond) {
+
+   ASSERT(cond!=NULL);
+
+#ifdef _WIN32
+   WakeConditionVariable(cond);
+#else
+   pthread_cond_signal(cond);
+#endif
+}
+
+// my_cond_broadcast()
+
+void my_cond_broadcast(my_cond_t * cond) {
+
+   ASSERT(cond!=NULL);
+
+#ifdef _WIN32
+   WakeAllConditionVariable(cond);
+#else
+   pthread_cond_broadcast(cond);
+#endif
+}
+
+// my_atomic_add()
+// returns the new value
+
+int my_atomic_add(volatile int * value, int delta) {
+
+   ASSERT(value!=NULL);
+
+#ifdef _WIN32
+   return InterlockedExchangeAdd((volatile LONG *) value,delta) + delta;
+#else
+   return __sync_add_and_fetch(value,delta);
+#endif
+}
+
+// my_cpu_nb()
+
+int my_cpu_nb() {
+
+   int n;
+
+#ifdef _WIN32
+   SYSTEM_INFO info;
+   GetSystemInfo(&info);
+   n = info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+   n = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+   n = 1;
+#endif
+
+   return (n < 1) ? 1 : n;
+}
+
+// thread_start()
+
+#ifdef _WIN32
+static DWORD WINAPI thread_start(LPVOID arg) {
+#else
+static void * thread_start(void * arg) {
+#endif
+
+   start_t start[1];
+
+   ASSERT(arg!=NULL);
+
+   *start = *((start_t *) arg);
+   my_free(arg);
+
+   start->func(start->arg);
+
+#ifdef _WIN32
+   return 0;
+#else
+   return NULL;
+#endif
+}
+
+// end of thread.c
@@ -0,0 +1,54 @@
+
+// thread.h
+
+#ifndef THREAD_H
+#define THREAD_H
+
+// includes
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "util.h"
+
+// types
+
+#ifdef _WIN32
+typedef HANDLE my_thread_t;
+typedef CRITICAL_SECTION my_mutex_t;
+typedef CONDITION_VARIABLE my_cond_t;
+#else
+typedef pthread_t my_thread_t;
+typedef pthread_mutex_t my_mutex_t;
+typedef pthread_cond_t my_cond_t;
+#endif
+
+typedef void (*my_thread_func_t) (void * arg);
+
+// functions
+
+extern void my_thread_create   (my_thread_t * thread, my_thread_func_t func, void * arg);
+extern void my_thread_join     (my_thread_t * thread);
+extern void my_thread_detach   (my_thread_t * thread);
+
+extern void my_mutex_init      (my_mutex_t * mutex);
+extern void my_mutex_free      (my_mutex_t * mutex);
+extern void my_mutex_lock      (my_mutex_t * mutex);
+extern void my_mutex_unlock    (my_mutex_t * mutex);
+
+extern void my_cond_init       (my_cond_t * cond);
+extern void my_cond_free       (my_cond_t * cond);
+extern void my_cond_wait       (my_cond_t * cond, my_mutex_t * mutex);
+extern void my_cond_signal     (my_cond_t * cond);
+extern void my_cond_broadcast  (my_cond_t * cond);
+
+extern int  my_atomic_add      (volatile int * value, int delta);
+
+extern int  my_cpu_nb          ();
+
+#endif // !defined THREAD_H
+
+// end of thread.h
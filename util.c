@@ -6,8 +6,10 @@
 #ifdef _WIN32
 #include <windows.h>
 #include <direct.h>
+#include <io.h>
 #else
 #include <unistd.h>
+#include <sys/mman.h>
 #endif
 
 #include <ctype.h>
@@ -271,6 +273,46 @@ int my_mkdir(const char *path){
 }
 
 
+// my_file_map()
+// read-only view of a whole file, NULL if the platform refuses
+
+const void * my_file_map(FILE * file, size_t size){
+    void *address;
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+    ASSERT(file!=NULL);
+    if(size==0){
+        return NULL;
+    }
+#ifdef _WIN32
+    mapping=CreateFileMapping((HANDLE)_get_osfhandle(_fileno(file)),
+                              NULL,PAGE_READONLY,0,0,NULL);
+    if(mapping==NULL){
+        return NULL;
+    }
+    address=MapViewOfFile(mapping,FILE_MAP_READ,0,0,size);
+    CloseHandle(mapping); // the view keeps the mapping alive
+#else
+    address=mmap(NULL,size,PROT_READ,MAP_SHARED,fileno(file),0);
+    if(address==MAP_FAILED){
+        return NULL;
+    }
+#endif
+    return address;
+}
+
+// my_file_unmap()
+
+void my_file_unmap(const void *address, size_t size){
+    ASSERT(address!=NULL);
+#ifdef _WIN32
+    UnmapViewOfFile(address);
+#else
+    munmap((void*)address,size);
+#endif
+}
+
 // my_string_empty()
 
 bool my_string_empty(const char string[]) {
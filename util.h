@@ -64,6 +64,12 @@
 #  define ASSERT(a)
 #endif
 
+#if defined(__GNUC__)
+#  define PREFETCH(a) __builtin_prefetch(a)
+#else
+#  define PREFETCH(a)
+#endif
+
 #ifdef _WIN32
 #define snprintf _snprintf
 #endif
@@ -154,6 +160,9 @@ extern void   my_path_join          (char *join_path, const char *path, const ch
 
 extern int    my_mkdir              (const char *path);
 
+extern const void * my_file_map     (FILE * file, size_t size);
+extern void   my_file_unmap         (const void * address, size_t size);
+
 extern bool   my_string_empty       (const char string[]);
 extern bool   my_string_whitespace  (const char string[]);
 extern bool   my_string_equal       (const char string_1[], const char string_2[]);